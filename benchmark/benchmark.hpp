@@ -0,0 +1,213 @@
+/***************************************************************************
+ *            benchmark.hpp
+ *
+ *  Copyright  2022  Luca Geretti
+ ****************************************************************************/
+
+/*
+ * This file is part of ConcLog, under the MIT license.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*!\file benchmark.hpp
+ * \brief Utilities shared by the benchmarks.
+ */
+
+#ifndef CONCLOG_BENCHMARK_HPP
+#define CONCLOG_BENCHMARK_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+#include "logging.hpp"
+
+namespace ConcLog {
+
+//! \brief A stream buffer discarding everything, to measure the logger without the cost of the output
+class NullStreamBuffer : public std::streambuf {
+  protected:
+    int_type overflow(int_type c) override { return traits_type::not_eof(c); }
+    std::streamsize xsputn(char const*, std::streamsize n) override { return n; }
+};
+
+//! \brief A stream buffer discarding everything, but waiting for a given delay on each line, to simulate a slow device
+class SlowStreamBuffer : public std::streambuf {
+  public:
+    SlowStreamBuffer(std::chrono::microseconds delay) : _delay(delay) { }
+  protected:
+    int_type overflow(int_type c) override {
+        if (c == '\n') _wait();
+        return traits_type::not_eof(c);
+    }
+    std::streamsize xsputn(char const* s, std::streamsize n) override {
+        for (std::streamsize i=0; i<n; ++i) if (s[i] == '\n') _wait();
+        return n;
+    }
+  private:
+    //! \brief Busy wait, since sleeping is too coarse for short delays
+    void _wait() const {
+        auto end = std::chrono::steady_clock::now()+_delay;
+        while (std::chrono::steady_clock::now() < end) { }
+    }
+  private:
+    std::chrono::microseconds const _delay;
+};
+
+//! \brief A registry with no threads, since benchmark threads are registered automatically and joined before changing scheduler
+class BenchmarkThreadRegistry : public ThreadRegistryInterface {
+  public:
+    bool has_threads_registered() const override { return false; }
+};
+
+enum class SchedulerKind { IMMEDIATE, BLOCKING, NONBLOCKING };
+
+inline std::ostream& operator<<(std::ostream& os, SchedulerKind const& k) {
+    switch(k) {
+        default : [[fallthrough]];
+        case SchedulerKind::IMMEDIATE : os << "immediate"; break;
+        case SchedulerKind::BLOCKING : os << "blocking"; break;
+        case SchedulerKind::NONBLOCKING : os << "nonblocking"; break;
+    }
+    return os;
+}
+
+inline void use_scheduler(SchedulerKind k) {
+    switch(k) {
+        default : [[fallthrough]];
+        case SchedulerKind::IMMEDIATE : Logger::instance().use_immediate_scheduler(); break;
+        case SchedulerKind::BLOCKING : Logger::instance().use_blocking_scheduler(); break;
+        case SchedulerKind::NONBLOCKING : Logger::instance().use_nonblocking_scheduler(); break;
+    }
+}
+
+//! \brief The destination of the log output: NULL_SINK discards it, FILE_SINK writes it to a temporary file
+enum class SinkKind { NULL_SINK, FILE_SINK };
+
+inline std::ostream& operator<<(std::ostream& os, SinkKind const& k) {
+    switch(k) {
+        default : [[fallthrough]];
+        case SinkKind::NULL_SINK : os << "null"; break;
+        case SinkKind::FILE_SINK : os << "file"; break;
+    }
+    return os;
+}
+
+//! \brief Redirects the log output to a sink for the lifetime of the object
+//! \details The null sink replaces the buffer of std::clog directly, the file sink uses Logger::redirect_to_file
+class SinkGuard {
+  public:
+    SinkGuard(SinkKind kind) : _kind(kind), _previous_buffer(std::clog.rdbuf()) {
+        if (_kind == SinkKind::NULL_SINK) std::clog.rdbuf(&_null_buffer);
+        else Logger::instance().redirect_to_file(FILENAME);
+    }
+    ~SinkGuard() {
+        Logger::instance().flush();
+        if (_kind == SinkKind::FILE_SINK) {
+            Logger::instance().redirect_to_console();
+            std::remove(FILENAME);
+        }
+        std::clog.rdbuf(_previous_buffer);
+    }
+    SinkGuard(SinkGuard const&) = delete;
+    SinkGuard& operator=(SinkGuard const&) = delete;
+  private:
+    static constexpr char const* FILENAME = "conclog_benchmark.log";
+    SinkKind const _kind;
+    NullStreamBuffer _null_buffer;
+    std::streambuf* const _previous_buffer;
+};
+
+//! \brief Run \a f with the index of the thread on \a num_threads threads started together
+//! \return The time from the start to the join of all the threads
+inline std::chrono::nanoseconds run_on_threads(unsigned int num_threads, std::function<void(unsigned int)> const& f) {
+    std::atomic<bool> go(false);
+    std::atomic<unsigned int> num_ready(0);
+    std::vector<std::thread> threads;
+    for (unsigned int i=0; i<num_threads; ++i)
+        threads.emplace_back([&,i] { ++num_ready; while (not go.load()) std::this_thread::yield(); f(i); });
+    while (num_ready.load() < num_threads) std::this_thread::yield();
+    auto start = std::chrono::steady_clock::now();
+    go = true;
+    for (auto& thread : threads) thread.join();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-start);
+}
+
+//! \brief Options common to the benchmarks, from the command line
+struct BenchmarkOptions {
+    std::string output; // The CSV file, standard output if empty
+    unsigned int messages = 20000; // Per run, split among the threads
+    unsigned int max_threads = 64;
+    unsigned int background_threads = 4; // Competing producers, for latency measurements
+    unsigned int sink_delay_us = 50; // Per line written to a slow sink
+
+    //! \brief Parse --output <file>, --messages <n>, --max-threads <n>, --background-threads <n> and --sink-delay-us <n>,
+    //! returning false on errors
+    bool parse(int argc, char* argv[]) {
+        for (int i=1; i<argc; ++i) {
+            std::string arg = argv[i];
+            if (i+1 == argc) return false;
+            std::string value = argv[++i];
+            if (arg == "--output") output = value;
+            else if (arg == "--messages") { if (not parse_unsigned(value,messages)) return false; }
+            else if (arg == "--max-threads") { if (not parse_unsigned(value,max_threads)) return false; }
+            else if (arg == "--background-threads") { if (not parse_unsigned(value,background_threads)) return false; }
+            else if (arg == "--sink-delay-us") { if (not parse_unsigned(value,sink_delay_us)) return false; }
+            else return false;
+        }
+        return messages > 0 and max_threads > 0;
+    }
+
+    //! \brief Parse the whole \a value as an unsigned integer into \a result, returning false if it is not one or it is too large
+    static bool parse_unsigned(std::string const& value, unsigned int& result) {
+        // Also rejects signs, which std::stoul would accept
+        if (value.empty() or value.find_first_not_of("0123456789") != std::string::npos) return false;
+        try {
+            auto parsed = std::stoul(value);
+            if (parsed > std::numeric_limits<unsigned int>::max()) return false;
+            result = static_cast<unsigned int>(parsed);
+            return true;
+        } catch (std::out_of_range const&) {
+            return false;
+        }
+    }
+};
+
+//! \brief The stream for the CSV results, according to the \a options
+class CsvOutput {
+  public:
+    CsvOutput(BenchmarkOptions const& options) {
+        if (not options.output.empty()) _file.open(options.output);
+    }
+    std::ostream& stream() { return _file.is_open() ? _file : std::cout; }
+  private:
+    std::ofstream _file;
+};
+
+} // namespace ConcLog
+
+#endif // CONCLOG_BENCHMARK_HPP
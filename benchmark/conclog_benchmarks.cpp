@@ -0,0 +1,169 @@
+/***************************************************************************
+ *            conclog_benchmarks.cpp
+ *
+ *  Copyright  2022  Luca Geretti
+ ****************************************************************************/
+
+/*
+ * This file is part of ConcLog, under the MIT license.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "benchmark.hpp"
+
+using namespace ConcLog;
+
+namespace {
+
+const SchedulerKind SCHEDULERS[] = { SchedulerKind::IMMEDIATE, SchedulerKind::BLOCKING, SchedulerKind::NONBLOCKING };
+const SinkKind SINKS[] = { SinkKind::NULL_SINK, SinkKind::FILE_SINK };
+
+void print_hold_loop(unsigned int num_holds) {
+    CONCLOG_SCOPE_CREATE
+    for (unsigned int i=0; i<num_holds; ++i) CONCLOG_SCOPE_PRINTHOLD("step " << i << " of " << num_holds)
+}
+
+} // namespace
+
+//! \brief Throughput benchmarks of the schedulers, written as CSV rows
+//! \details The producer time is until all threads have submitted, the total time is until all messages have been written
+class ThroughputBenchmarks {
+  public:
+    ThroughputBenchmarks(BenchmarkOptions const& options) : _options(options), _csv(options) { }
+
+    void run() {
+        _csv.stream() << "benchmark,scheduler,sink,threads,variant,messages,producer_ns,total_ns,messages_per_second,ns_per_message" << std::endl;
+        for (auto scheduler : SCHEDULERS) {
+            use_scheduler(scheduler);
+            for (auto sink : SINKS) {
+                run_muted_call(scheduler,sink);
+                run_println_throughput(scheduler,sink);
+                run_theme(scheduler,sink);
+                run_format(scheduler,sink);
+                run_multiline(scheduler,sink);
+                run_hold_churn(scheduler,sink);
+            }
+        }
+        Logger::instance().use_immediate_scheduler();
+    }
+
+  private:
+    //! \brief The cost of a call filtered out by the verbosity
+    void run_muted_call(SchedulerKind scheduler, SinkKind sink) {
+        Logger::instance().configuration().set_verbosity(0);
+        auto messages = _options.messages*100;
+        _measure("muted_call",scheduler,sink,1,"default",messages,[messages](unsigned int) {
+            for (unsigned int i=0; i<messages; ++i) CONCLOG_PRINTLN_AT(1,"muted " << i)
+        });
+    }
+
+    //! \brief Plain lines from an increasing number of threads
+    //! \details The immediate scheduler is not designed for concurrency, hence it is run on one thread only
+    void run_println_throughput(SchedulerKind scheduler, SinkKind sink) {
+        Logger::instance().configuration().set_verbosity(1);
+        for (unsigned int num_threads=1; num_threads<=_options.max_threads; num_threads*=2) {
+            if (scheduler == SchedulerKind::IMMEDIATE and num_threads > 1) break;
+            auto messages_per_thread = std::max(_options.messages/num_threads,1u);
+            _measure("println_throughput",scheduler,sink,num_threads,"default",messages_per_thread*num_threads,[messages_per_thread](unsigned int t) {
+                for (unsigned int i=0; i<messages_per_thread; ++i) CONCLOG_PRINTLN("thread " << t << " message " << i)
+            });
+        }
+    }
+
+    //! \brief Lines rich in keywords and numbers, with and without a theme
+    void run_theme(SchedulerKind scheduler, SinkKind sink) {
+        Logger::instance().configuration().set_verbosity(1);
+        auto messages = _options.messages;
+        for (bool themed : {false,true}) {
+            Logger::instance().configuration().set_theme(themed ? TT_THEME_DARK : TT_THEME_NONE);
+            _measure("theme",scheduler,sink,1,themed ? "dark" : "none",messages,[messages](unsigned int) {
+                for (unsigned int i=0; i<messages; ++i)
+                    CONCLOG_PRINTLN("val=inf, x0=2.0^3*1.32424242432423[2,3], y>[0.1:0.2] (z={0:1}), " << i << ", x0, x11, true@1.")
+            });
+        }
+        Logger::instance().configuration().set_theme(TT_THEME_NONE);
+    }
+
+    //! \brief Lines with numbers, formatted through the stream, deferred with CONCLOG_PRINTLN_FMT or typed with CONCLOG_PRINTLN_TYPED
+    void run_format(SchedulerKind scheduler, SinkKind sink) {
+        Logger::instance().configuration().set_verbosity(1);
+        auto messages = _options.messages;
+        _measure("format",scheduler,sink,1,"stream",messages,[messages](unsigned int) {
+            for (unsigned int i=0; i<messages; ++i) CONCLOG_PRINTLN("i=" << i << ", x=" << 1.5*i << ", y=" << 0.25*i)
+        });
+        _measure("format",scheduler,sink,1,"deferred",messages,[messages](unsigned int) {
+            for (unsigned int i=0; i<messages; ++i) CONCLOG_PRINTLN_FMT(0,"i={}, x={}, y={}",i,1.5*i,0.25*i)
+        });
+        _measure("format",scheduler,sink,1,"typed",messages,[messages](unsigned int) {
+            for (unsigned int i=0; i<messages; ++i) CONCLOG_PRINTLN_TYPED(0,CONCLOG_FORMAT("i={d}, x={f}, y={f}"),i,1.5*i,0.25*i)
+        });
+    }
+
+    //! \brief Payloads with newlines and lines longer than the window, which are split on output
+    void run_multiline(SchedulerKind scheduler, SinkKind sink) {
+        Logger::instance().configuration().set_verbosity(1);
+        auto messages = _options.messages;
+        std::string const payload = "first line\nsecond line\n" + std::string(300,'x') + "\nlast line";
+        _measure("multiline",scheduler,sink,1,"default",messages,[messages,&payload](unsigned int) {
+            for (unsigned int i=0; i<messages; ++i) CONCLOG_PRINTLN(payload << i)
+        });
+    }
+
+    //! \brief Held lines replaced at a high rate, as done by progress indicators
+    //! \details Fewer messages are used since each print of the held line sleeps
+    void run_hold_churn(SchedulerKind scheduler, SinkKind sink) {
+        // The scope increases the level of the thread
+        Logger::instance().configuration().set_verbosity(2);
+        auto holds = std::max(_options.messages/20,1u);
+        _measure("hold_churn",scheduler,sink,1,"default",holds,[holds](unsigned int) { print_hold_loop(holds); });
+    }
+
+    void _measure(char const* benchmark, SchedulerKind scheduler, SinkKind sink, unsigned int num_threads, char const* variant,
+                  unsigned int messages, std::function<void(unsigned int)> const& f) {
+        std::chrono::nanoseconds producer_time, total_time;
+        {
+            SinkGuard guard(sink);
+            auto start = std::chrono::steady_clock::now();
+            producer_time = run_on_threads(num_threads,f);
+            Logger::instance().flush();
+            total_time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-start);
+        }
+        auto ns = static_cast<double>(total_time.count());
+        _csv.stream() << benchmark << ',' << scheduler << ',' << sink << ',' << num_threads << ',' << variant << ',' << messages << ','
+                      << producer_time.count() << ',' << total_time.count() << ',' << static_cast<uint64_t>(messages*1e9/ns) << ','
+                      << ns/messages << std::endl;
+    }
+
+  private:
+    BenchmarkOptions const _options;
+    CsvOutput _csv;
+};
+
+int main(int argc, char* argv[]) {
+    BenchmarkOptions options;
+    if (not options.parse(argc,argv)) {
+        std::cerr << "Usage: " << argv[0] << " [--output <csv file>] [--messages <count per run>] [--max-threads <count>]" << std::endl;
+        return 1;
+    }
+    BenchmarkThreadRegistry registry;
+    Logger::instance().attach_thread_registry(&registry);
+    Logger::instance().configuration().set_prints_level_on_change_only(false);
+    ThroughputBenchmarks(options).run();
+    return 0;
+}
@@ -0,0 +1,186 @@
+/***************************************************************************
+ *            conclog_latency_benchmark.cpp
+ *
+ *  Copyright  2022  Luca Geretti
+ ****************************************************************************/
+
+/*
+ * This file is part of ConcLog, under the MIT license.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include "benchmark.hpp"
+
+using namespace ConcLog;
+
+namespace {
+
+const SchedulerKind SCHEDULERS[] = { SchedulerKind::IMMEDIATE, SchedulerKind::BLOCKING, SchedulerKind::NONBLOCKING };
+
+//! \brief The background activity while measuring: NONE, competing PRODUCERS, a SLOW_SINK or HELD_LINES replaced continuously
+enum class LoadKind { NONE, PRODUCERS, SLOW_SINK, HELD_LINES };
+
+const LoadKind LOADS[] = { LoadKind::NONE, LoadKind::PRODUCERS, LoadKind::SLOW_SINK, LoadKind::HELD_LINES };
+
+std::ostream& operator<<(std::ostream& os, LoadKind const& k) {
+    switch(k) {
+        default : [[fallthrough]];
+        case LoadKind::NONE : os << "none"; break;
+        case LoadKind::PRODUCERS : os << "producers"; break;
+        case LoadKind::SLOW_SINK : os << "slow_sink"; break;
+        case LoadKind::HELD_LINES : os << "held_lines"; break;
+    }
+    return os;
+}
+
+// A call is an outlier when slower than this factor times the median
+const unsigned int OUTLIER_FACTOR = 10;
+// The shortest sleep of the held line printing, for the first level
+const std::chrono::nanoseconds HELD_LINE_SLEEP = std::chrono::microseconds(10);
+const unsigned int NUM_WARMUP_CALLS = 100;
+
+void print_hold_loop(unsigned int num_holds) {
+    CONCLOG_SCOPE_CREATE
+    for (unsigned int i=0; i<num_holds; ++i) CONCLOG_SCOPE_PRINTHOLD("step " << i << " of " << num_holds)
+}
+
+//! \brief The time of a call and the part of it spent blocked on a contended lock
+struct CallSample {
+    std::chrono::nanoseconds latency;
+    std::chrono::nanoseconds blocked;
+};
+
+} // namespace
+
+//! \brief Latency of CONCLOG_PRINTLN calls on a control thread, under background load, written as CSV rows
+//! \details Outliers are attributed to lock contention when most of the call is spent blocked. With held lines active
+//! and a scheduler printing on the producer thread, they are attributed instead to the sleep of the held line printing,
+//! which the call either waits for while blocked or performs itself after printing its own line. With the nonblocking
+//! scheduler that sleep happens on the consumer thread, so blocked producers are only contending for the queues.
+class ProducerLatencyBenchmark {
+  public:
+    ProducerLatencyBenchmark(BenchmarkOptions const& options) : _options(options), _csv(options) { }
+
+    void run() {
+        _csv.stream() << "scheduler,load,calls,mean_ns,stddev_ns,p50_ns,p90_ns,p99_ns,p999_ns,max_ns,"
+                         "outliers,lock_contention_outliers,held_line_sleep_outliers,other_outliers" << std::endl;
+        Logger::instance().configuration().set_verbosity(2);
+        for (auto scheduler : SCHEDULERS) {
+            use_scheduler(scheduler);
+            for (auto load : LOADS) {
+                // The immediate scheduler is not designed for concurrency
+                if (scheduler == SchedulerKind::IMMEDIATE and (load == LoadKind::PRODUCERS or load == LoadKind::HELD_LINES)) continue;
+                _report(scheduler,load,_measure(load));
+            }
+        }
+        Logger::instance().use_immediate_scheduler();
+    }
+
+  private:
+    std::vector<CallSample> _measure(LoadKind load) {
+        NullStreamBuffer null_buffer;
+        SlowStreamBuffer slow_buffer(std::chrono::microseconds(_options.sink_delay_us));
+        auto previous_buffer = std::clog.rdbuf(load == LoadKind::SLOW_SINK ? static_cast<std::streambuf*>(&slow_buffer) : &null_buffer);
+
+        std::atomic<bool> stop(false);
+        std::vector<std::thread> background;
+        if (load == LoadKind::PRODUCERS) {
+            for (unsigned int t=0; t<_options.background_threads; ++t)
+                background.emplace_back([&stop,t] {
+                    for (unsigned int i=0; not stop.load(); ++i) CONCLOG_PRINTLN("background " << t << " message " << i)
+                });
+        } else if (load == LoadKind::HELD_LINES) {
+            background.emplace_back([&stop] { while (not stop.load()) print_hold_loop(100); });
+        }
+
+        std::vector<CallSample> samples;
+        std::thread control([this,&samples] {
+            samples.reserve(_options.messages);
+            for (unsigned int i=0; i<NUM_WARMUP_CALLS; ++i) CONCLOG_PRINTLN("warmup " << i)
+            for (unsigned int i=0; i<_options.messages; ++i) {
+                auto blocked_before = Logger::instance().current_thread_statistics().producer_blocked_time;
+                auto start = std::chrono::steady_clock::now();
+                CONCLOG_PRINTLN("control " << i)
+                auto end = std::chrono::steady_clock::now();
+                auto blocked_after = Logger::instance().current_thread_statistics().producer_blocked_time;
+                samples.push_back({std::chrono::duration_cast<std::chrono::nanoseconds>(end-start),blocked_after-blocked_before});
+            }
+        });
+        control.join();
+        stop = true;
+        for (auto& thread : background) thread.join();
+        Logger::instance().flush();
+        std::clog.rdbuf(previous_buffer);
+        return samples;
+    }
+
+    void _report(SchedulerKind scheduler, LoadKind load, std::vector<CallSample> const& samples) {
+        std::vector<int64_t> latencies;
+        for (auto const& sample : samples) latencies.push_back(sample.latency.count());
+        std::sort(latencies.begin(),latencies.end());
+        auto percentile = [&latencies](double q) {
+            auto index = static_cast<std::size_t>(std::ceil(q*static_cast<double>(latencies.size())));
+            return latencies[std::min(std::max(index,std::size_t(1)),latencies.size())-1];
+        };
+        double mean = 0, variance = 0;
+        for (auto l : latencies) mean += static_cast<double>(l);
+        mean /= static_cast<double>(latencies.size());
+        for (auto l : latencies) variance += (static_cast<double>(l)-mean)*(static_cast<double>(l)-mean);
+        variance /= static_cast<double>(latencies.size());
+
+        const auto threshold = std::chrono::nanoseconds(OUTLIER_FACTOR*percentile(0.5));
+        // Only when printing on the producer thread does a call reprint the held line, or wait for another thread doing so
+        const bool prints_held_lines = (load == LoadKind::HELD_LINES and scheduler != SchedulerKind::NONBLOCKING);
+        SizeType outliers = 0, lock_contention = 0, held_line_sleep = 0;
+        for (auto const& sample : samples) {
+            if (sample.latency <= threshold) continue;
+            ++outliers;
+            bool mostly_blocked = 2*sample.blocked >= sample.latency;
+            // The reprint after the own line always sleeps, so a call performing it spends at least that sleep unblocked
+            bool performs_sleep = (sample.latency-sample.blocked >= HELD_LINE_SLEEP);
+            if (prints_held_lines and (mostly_blocked or performs_sleep)) ++held_line_sleep;
+            else if (mostly_blocked) ++lock_contention;
+        }
+
+        _csv.stream() << scheduler << ',' << load << ',' << samples.size() << ',' << static_cast<int64_t>(mean) << ','
+                      << static_cast<int64_t>(std::sqrt(variance)) << ',' << percentile(0.5) << ',' << percentile(0.9) << ','
+                      << percentile(0.99) << ',' << percentile(0.999) << ',' << latencies.back() << ',' << outliers << ','
+                      << lock_contention << ',' << held_line_sleep << ',' << outliers-lock_contention-held_line_sleep << std::endl;
+    }
+
+  private:
+    BenchmarkOptions const _options;
+    CsvOutput _csv;
+};
+
+int main(int argc, char* argv[]) {
+    BenchmarkOptions options;
+    if (not options.parse(argc,argv)) {
+        std::cerr << "Usage: " << argv[0] << " [--output <csv file>] [--messages <calls per run>] [--background-threads <count>] "
+                  << "[--sink-delay-us <microseconds per line>]" << std::endl;
+        return 1;
+    }
+    BenchmarkThreadRegistry registry;
+    Logger::instance().attach_thread_registry(&registry);
+    Logger::instance().configuration().set_prints_level_on_change_only(false);
+    ProducerLatencyBenchmark(options).run();
+    return 0;
+}
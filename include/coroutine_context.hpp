@@ -0,0 +1,110 @@
+/***************************************************************************
+ *            coroutine_context.hpp
+ *
+ *  Copyright  2021  Luca Geretti
+ *
+ ****************************************************************************/
+
+/*
+ * This file is part of ConcLog, under the MIT license.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef CONCLOG_COROUTINE_CONTEXT_HPP
+#define CONCLOG_COROUTINE_CONTEXT_HPP
+
+#if __has_include(<coroutine>) and defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+#include <type_traits>
+#include "logging.hpp"
+
+namespace ConcLog {
+
+//! \brief The logging contexts swapped in the thread that runs a coroutine
+struct LogCoroutineContexts {
+    LogCoroutineContexts() : coroutine(Logger::instance().current_context()), resumer(coroutine) { }
+    //! \brief The context of the coroutine, restored on each resumption
+    LogContext coroutine;
+    //! \brief The context of the thread that last resumed the coroutine, restored on each suspension
+    LogContext resumer;
+};
+
+//! \brief Get the awaiter of an \a awaitable, which is the awaitable itself unless it has a member operator co_await
+template<class T> decltype(auto) log_context_awaiter_of(T& awaitable) {
+    if constexpr (requires { awaitable.operator co_await(); }) return awaitable.operator co_await();
+    else return (awaitable);
+}
+
+//! \brief Wraps an awaitable so that the thread running the coroutine switches to its context on resumption,
+//! and back to its own context on suspension
+//! \details Awaitables with a non-member operator co_await are not supported
+template<class A> class LogContextAwaiter {
+    using Awaiter = decltype(log_context_awaiter_of(std::declval<std::remove_reference_t<A>&>()));
+  public:
+    LogContextAwaiter(A&& awaitable, LogCoroutineContexts& contexts)
+        : _awaitable(std::forward<A>(awaitable)), _awaiter(log_context_awaiter_of(_awaitable)), _contexts(contexts), _suspended(false) { }
+    // The awaiter may refer to the awaitable held
+    LogContextAwaiter(LogContextAwaiter const&) = delete;
+    void operator=(LogContextAwaiter const&) = delete;
+
+    bool await_ready() noexcept(noexcept(std::declval<Awaiter&>().await_ready())) { return _awaiter.await_ready(); }
+
+    template<class P> decltype(auto) await_suspend(std::coroutine_handle<P> handle) noexcept(noexcept(std::declval<Awaiter&>().await_suspend(handle))) {
+        // The coroutine may be resumed by another thread as soon as the awaiter suspends, hence the contexts are swapped first
+        _suspended = true;
+        Logger::instance().switch_context(_contexts.resumer,_contexts.coroutine);
+        return _awaiter.await_suspend(handle);
+    }
+
+    decltype(auto) await_resume() noexcept(noexcept(std::declval<Awaiter&>().await_resume())) {
+        if (_suspended) Logger::instance().switch_context(_contexts.coroutine,_contexts.resumer);
+        return _awaiter.await_resume();
+    }
+
+  private:
+    A _awaitable;
+    Awaiter _awaiter;
+    LogCoroutineContexts& _contexts;
+    bool _suspended;
+};
+
+//! \brief Mixin for the promise type of a coroutine, giving the coroutine its own logging context
+//! \details The context is captured from the creating thread and wraps every co_await of the body. The initial and final
+//! suspensions of the promise must be wrapped explicitly with log_context_awaiter(), to start and end in the right context:
+//! \code
+//! struct promise_type : LogContextPromise {
+//!     auto initial_suspend() { return log_context_awaiter(std::suspend_always{}); }
+//!     auto final_suspend() noexcept { return log_context_awaiter(std::suspend_always{}); }
+//!     ...
+//! };
+//! \endcode
+class LogContextPromise {
+  public:
+    template<class A> auto log_context_awaiter(A&& awaitable) { return LogContextAwaiter<A>(std::forward<A>(awaitable),_contexts); }
+    template<class A> auto await_transform(A&& awaitable) { return log_context_awaiter(std::forward<A>(awaitable)); }
+  private:
+    LogCoroutineContexts _contexts;
+};
+
+} // namespace ConcLog
+
+#endif // __has_include(<coroutine>) and defined(__cpp_impl_coroutine)
+
+#endif // CONCLOG_COROUTINE_CONTEXT_HPP
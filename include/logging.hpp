@@ -31,15 +31,26 @@
 
 #include <iostream>
 #include <fstream>
+#include <cstdint>
 #include <cstring>
 #include <utility>
 #include <vector>
-#include <queue>
+#include <deque>
 #include <map>
+#include <set>
 #include <sstream>
 #include <thread>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <future>
 #include <memory>
+#include <chrono>
+#include <array>
+#include <charconv>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
 
 #include "thread_registry_interface.hpp"
 
@@ -57,20 +68,40 @@
 #define CONCLOG_SCOPE_CREATE auto logscopemanager = LogScopeManager(CONCLOG_PRETTY_FUNCTION);
 // Managed level increase/decrease around the function fn; if the function throws, manual decrease of the proper level is required.
 #define CONCLOG_RUN_AT(level,fn) Logger::instance().increase_level(level); fn; Logger::instance().decrease_level(level);
+// Record a value on the counter track with the given name, if tracing
+#define CONCLOG_TRACE_COUNTER(name,value) { if (Logger::instance().is_tracing()) Logger::instance().trace_counter(name,value); }
 // Mute the logger for the function fn; if the function throws, manual decrease of the proper level is required.
 #define CONCLOG_RUN_MUTED(fn) Logger::instance().mute_increase_level(); fn; Logger::instance().mute_decrease_level();
+// Register once the static description of the call site of a macro, named conclog_callsite; meant for internal use by the other macros.
+#define CONCLOG_CALLSITE(level,format) static LogCallsite conclog_callsite(__FILE__,__LINE__,CONCLOG_PRETTY_FUNCTION,level,format);
+// The first of the arguments of a variadic macro, to be called with a trailing comma; meant for internal use by the other macros.
+#define CONCLOG_FIRST_ARGUMENT(first,...) first
+// Submit the text, built through a stream, to the Logger function, at the given level, from the call site; meant for internal use by the other macros.
+#define CONCLOG_STREAM_TO(function,level,text) { LogCallsiteMark logger_callsite_mark(conclog_callsite); LogTextStreamLease logger_stream; logger_stream.stream() << text; Logger::instance().function(level,logger_stream.take()); }
 // Print one line at the current level; the text shouldn't have carriage returns, but for efficiency purposes this is not checked.
-#define CONCLOG_PRINTLN(text) { if (!Logger::instance().is_muted_at(0)) { std::ostringstream logger_stream; logger_stream << std::boolalpha << text; Logger::instance().println(0,logger_stream.str()); } }
+// If muted, the line may still be captured by the flight recorder. Nothing is done if the call site is disabled.
+#define CONCLOG_PRINTLN(text) { CONCLOG_CALLSITE(0,#text) if (conclog_callsite.is_enabled()) { if (!Logger::instance().is_muted_at(0,conclog_callsite)) CONCLOG_STREAM_TO(println,0,text) else if (Logger::instance().is_recorded_at(0,conclog_callsite)) CONCLOG_STREAM_TO(record,0,text) } }
 // Print one line at an increased level with respect to the current one; the text shouldn't have carriage returns, but for efficiency purposes this is not checked.
-#define CONCLOG_PRINTLN_AT(level,text) { if (!Logger::instance().is_muted_at(level)) { std::ostringstream logger_stream; logger_stream << std::boolalpha << text; Logger::instance().println(level,logger_stream.str()); } }
+#define CONCLOG_PRINTLN_AT(level,text) { CONCLOG_CALLSITE(level,#text) if (conclog_callsite.is_enabled()) { if (!Logger::instance().is_muted_at(level,conclog_callsite)) CONCLOG_STREAM_TO(println,level,text) else if (Logger::instance().is_recorded_at(level,conclog_callsite)) CONCLOG_STREAM_TO(record,level,text) } }
 // Print variable in one line at the current level, using the formatting convention.
-#define CONCLOG_PRINTLN_VAR(var) { if (!Logger::instance().is_muted_at(0)) { std::ostringstream logger_stream; logger_stream << std::boolalpha << #var << " = " << var; Logger::instance().println(0,logger_stream.str()); } }
+#define CONCLOG_PRINTLN_VAR(var) { CONCLOG_CALLSITE(0,#var) if (conclog_callsite.is_enabled()) { if (!Logger::instance().is_muted_at(0,conclog_callsite)) CONCLOG_STREAM_TO(println,0,#var << " = " << var) else if (Logger::instance().is_recorded_at(0,conclog_callsite)) CONCLOG_STREAM_TO(record,0,#var << " = " << var) } }
 // Print variable in one line at the increased level with respect to the current one, using the formatting convention.
-#define CONCLOG_PRINTLN_VAR_AT(level,var) { if (!Logger::instance().is_muted_at(level)) { std::ostringstream logger_stream; logger_stream << std::boolalpha << #var << " = " << var; Logger::instance().println(level,logger_stream.str()); } }
+#define CONCLOG_PRINTLN_VAR_AT(level,var) { CONCLOG_CALLSITE(level,#var) if (conclog_callsite.is_enabled()) { if (!Logger::instance().is_muted_at(level,conclog_callsite)) CONCLOG_STREAM_TO(println,level,#var << " = " << var) else if (Logger::instance().is_recorded_at(level,conclog_callsite)) CONCLOG_STREAM_TO(record,level,#var << " = " << var) } }
+// Print one line at an increased level with respect to the current one, from a format whose "{}" placeholders are replaced by the trivially copyable arguments;
+// the arguments are copied as bytes and converted to text by the consumption thread of the nonblocking scheduler.
+#define CONCLOG_PRINTLN_FMT(level,...) { CONCLOG_CALLSITE(level,log_callsite_format(CONCLOG_FIRST_ARGUMENT(__VA_ARGS__,))) if (conclog_callsite.is_enabled()) { LogCallsiteMark logger_callsite_mark(conclog_callsite); \
+    if (!Logger::instance().is_muted_at(level,conclog_callsite)) Logger::instance().println_format(level,__VA_ARGS__); else if (Logger::instance().is_recorded_at(level,conclog_callsite)) Logger::instance().record_format(level,__VA_ARGS__); } }
+// Print one line at an increased level with respect to the current one, from a format created by CONCLOG_FORMAT followed by the arguments,
+// e.g. CONCLOG_PRINTLN_TYPED(0,CONCLOG_FORMAT("x={d}, y={f}"),x,y); the number and types of the arguments are checked at compile time.
+#define CONCLOG_PRINTLN_TYPED(level,...) { CONCLOG_CALLSITE(level,log_callsite_format(CONCLOG_FIRST_ARGUMENT(__VA_ARGS__,))) if (conclog_callsite.is_enabled()) { LogCallsiteMark logger_callsite_mark(conclog_callsite); \
+    if (!Logger::instance().is_muted_at(level,conclog_callsite)) Logger::instance().println_typed(level,__VA_ARGS__); else if (Logger::instance().is_recorded_at(level,conclog_callsite)) Logger::instance().record_typed(level,__VA_ARGS__); } }
+// Create a format parsed at compile time from the string literal s, for CONCLOG_PRINTLN_TYPED.
+#define CONCLOG_FORMAT(s) [] { struct LogFormatText { static constexpr std::string_view value() { return s; } }; return LogTypedFormat<LogFormatText>(); }()
 // Print a text at the bottom line, holding it until the function scope ends; this requires creation of the scope.
 // Nested calls in separate functions append to the held line.
 // The text for obvious reasons shouldn't have newlines and carriage returns; for efficiency purposes this is not checked.
-#define CONCLOG_SCOPE_PRINTHOLD(text) { if (!Logger::instance().is_muted_at(0)) { std::ostringstream logger_stream; logger_stream << std::boolalpha << text; Logger::instance().hold(CONCLOG_PRETTY_FUNCTION,logger_stream.str()); } }
+#define CONCLOG_SCOPE_PRINTHOLD(text) { CONCLOG_CALLSITE(0,#text) if (conclog_callsite.is_enabled() and !Logger::instance().is_muted_at(0,conclog_callsite)) { LogCallsiteMark logger_callsite_mark(conclog_callsite); \
+    LogTextStreamLease logger_stream; logger_stream.stream() << text; Logger::instance().hold(CONCLOG_PRETTY_FUNCTION,logger_stream.take()); } }
 
 namespace ConcLog {
 
@@ -82,8 +113,10 @@ using SizeType = size_t;
 class LoggerNoThreadRegistryException : public std::exception { };
 //! \brief Exception for trying to modify the thread registry, which should be immutable as soon as attached
 class LoggerModifyThreadRegistryException : public std::exception { };
-//! \brief Exception for trying to change the scheduler while there are registered threads
-class LoggerSchedulerChangeWithRegisteredThreadsException : public std::exception { };
+//! \brief Exception for referring to a thread that is not known to the logger
+class LoggerUnknownThreadException : public std::exception { };
+//! \brief Exception for a malformed list of verbosity filters
+class LoggerInvalidVerbosityFiltersException : public std::exception { };
 
 //! \brief A styling for a text character
 //! \details Refer to https://www.lihaoyi.com/post/BuildyourownCommandLinewithANSIescapecodes.html#256-colors
@@ -162,6 +195,339 @@ static TerminalTextTheme TT_THEME_LIGHT = TerminalTextTheme(TT_STYLE_BRIGHTORANG
                                                             TT_STYLE_LIGHTBROWN,TT_STYLE_OBSIDIAN,TT_STYLE_DARKORANGE,
                                                             TT_STYLE_DARKGREY,TT_STYLE_DARKGREY);
 
+//! \brief A stream buffer writing into a string, which keeps its capacity when cleared
+class LogTextBuffer : public std::streambuf {
+  public:
+    LogTextBuffer();
+    //! \brief The text written since the last clear
+    std::string& str();
+    void clear();
+  protected:
+    int_type overflow(int_type c) override;
+  private:
+    std::string _text;
+};
+
+struct LogTextStream;
+
+//! \brief Lends a formatting stream of the current thread for the lifetime of the object, reset to the default formatting
+//! \details Streams are reused by the thread, hence formatting does not allocate once their buffers are large enough;
+//! nested leases, such as when logging while evaluating the text of another log call, get distinct streams
+class LogTextStreamLease {
+  public:
+    LogTextStreamLease();
+    ~LogTextStreamLease();
+    LogTextStreamLease(LogTextStreamLease const&) = delete;
+    LogTextStreamLease& operator=(LogTextStreamLease const&) = delete;
+    std::ostream& stream();
+    //! \brief The text written to the stream, to be taken over by swapping it with another string
+    //! \details The stream must not be written afterwards, since the next lease resets it to the string swapped in
+    std::string&& take();
+  private:
+    LogTextStream* _stream;
+};
+
+//! \brief Write \a format to \a os up to the first placeholder "{}", returning the position after it, or nullptr if none
+char const* write_until_placeholder(std::ostream& os, char const* format);
+
+template<class T> char const* write_format_value(std::ostream& os, char const* format, T const& value) {
+    if (format == nullptr) return nullptr;
+    format = write_until_placeholder(os, format);
+    if (format != nullptr) os << value;
+    return format;
+}
+
+//! \brief Write \a format to \a os, replacing each placeholder "{}" with the next of the \a values
+//! \details Placeholders in excess are written as they are, values in excess are not written
+template<class... TS> void write_format(std::ostream& os, char const* format, TS const&... values) {
+    ((format = write_format_value(os, format, values)), ...);
+    if (format != nullptr) os << format;
+}
+
+//! \brief The type a deferred argument of type \a T is copied as, where arrays are copied as a pointer to their constant elements
+template<class T> using DeferredArgument = std::conditional_t<std::is_array<T>::value, std::remove_extent_t<T> const*, std::decay_t<T>>;
+
+template<class T> char* write_deferred_argument(char* position, T const& value) {
+    std::memcpy(position, &value, sizeof(T));
+    return position + sizeof(T);
+}
+
+template<class T> T read_deferred_argument(char const*& position) {
+    T value;
+    std::memcpy(&value, position, sizeof(T));
+    position += sizeof(T);
+    return value;
+}
+
+//! \brief Write \a format to \a os with the values of \a arguments, copied as bytes one after the other
+template<class... TS> void write_deferred_format(std::ostream& os, char const* format, char const* arguments) {
+    // The braced initialisation reads the arguments in order
+    std::tuple<TS...> values{read_deferred_argument<TS>(arguments)...};
+    std::apply([&os,format](TS const&... vs) { write_format(os, format, vs...); }, values);
+}
+
+//! \brief A format string along with the function writing it with the arguments copied as bytes
+struct LogDeferredFormat {
+    char const* format;
+    void (*write)(std::ostream& os, char const* format, char const* arguments);
+};
+
+//! \brief The kind of a placeholder of a typed format: ANY for "{}", INTEGER for "{d}", HEXADECIMAL for "{x}",
+//! FLOATING for "{f}", STRING for "{s}", or NONE for a segment with no placeholder
+enum class LogPlaceholderKind { NONE, ANY, INTEGER, HEXADECIMAL, FLOATING, STRING };
+
+//! \brief A literal segment of a typed format, followed by a placeholder unless NONE
+struct LogFormatSegment {
+    SizeType begin;
+    SizeType size;
+    LogPlaceholderKind placeholder;
+};
+
+//! \brief Not constexpr, hence calling it while parsing a format at compile time fails the build with its name
+void invalid_placeholder_in_log_format();
+
+//! \brief The kind of the placeholder starting at \a pos of \a format, with its \a length
+constexpr LogPlaceholderKind log_placeholder_kind_at(std::string_view format, SizeType pos, SizeType& length) {
+    length = 2;
+    if (pos+1 < format.size() and format[pos+1] == '}') return LogPlaceholderKind::ANY;
+    length = 3;
+    if (pos+2 < format.size() and format[pos+2] == '}') {
+        switch (format[pos+1]) {
+            case 'd' : return LogPlaceholderKind::INTEGER;
+            case 'x' : return LogPlaceholderKind::HEXADECIMAL;
+            case 'f' : return LogPlaceholderKind::FLOATING;
+            case 's' : return LogPlaceholderKind::STRING;
+            default : break;
+        }
+    }
+    invalid_placeholder_in_log_format();
+    return LogPlaceholderKind::NONE;
+}
+
+//! \brief Split \a format into segments, where "{{" and "}}" end a segment with a literal brace
+//! \details With no \a segments, only counts them
+constexpr SizeType parse_log_format(std::string_view format, LogFormatSegment* segments) {
+    SizeType count = 0, begin = 0, pos = 0;
+    while (pos < format.size()) {
+        if (format[pos] != '{' and format[pos] != '}') { ++pos; continue; }
+        if (pos+1 < format.size() and format[pos+1] == format[pos]) {
+            if (segments != nullptr) segments[count] = LogFormatSegment{begin, pos+1-begin, LogPlaceholderKind::NONE};
+            ++count;
+            pos += 2;
+        } else if (format[pos] == '}') {
+            ++pos;
+            continue;
+        } else {
+            SizeType length = 0;
+            auto kind = log_placeholder_kind_at(format, pos, length);
+            if (segments != nullptr) segments[count] = LogFormatSegment{begin, pos-begin, kind};
+            ++count;
+            pos += length;
+        }
+        begin = pos;
+    }
+    if (segments != nullptr) segments[count] = LogFormatSegment{begin, format.size()-begin, LogPlaceholderKind::NONE};
+    return count+1;
+}
+
+template<class T> constexpr bool is_log_string_v = std::is_same<T,char const*>::value or std::is_same<T,char*>::value or
+        std::is_same<T,std::string>::value or std::is_same<T,std::string_view>::value;
+
+//! \brief If a value of type \a T can replace a placeholder of the \a kind
+template<class T> constexpr bool log_placeholder_accepts(LogPlaceholderKind kind) {
+    using U = std::decay_t<T>;
+    switch (kind) {
+        case LogPlaceholderKind::ANY : return true;
+        case LogPlaceholderKind::INTEGER : [[fallthrough]];
+        case LogPlaceholderKind::HEXADECIMAL : return std::is_integral<U>::value and not std::is_same<U,bool>::value and not std::is_same<U,char>::value;
+        case LogPlaceholderKind::FLOATING : return std::is_floating_point<U>::value;
+        case LogPlaceholderKind::STRING : return is_log_string_v<U> or std::is_same<U,char>::value;
+        default : return false;
+    }
+}
+
+//! \brief Append \a value to \a text as a placeholder of the \a kind, with std::to_chars for numbers
+//! \details Floating point numbers use their shortest representation; types other than numbers, characters and
+//! strings, accepted by "{}" only, are written with the output operator into a reusable stream
+template<LogPlaceholderKind K, class T> void append_log_value(std::string& text, T const& value) {
+    using U = std::decay_t<T>;
+    if constexpr (std::is_same<U,bool>::value) {
+        text.append(value ? "true" : "false");
+    } else if constexpr (std::is_same<U,char>::value) {
+        text.push_back(value);
+    } else if constexpr (std::is_arithmetic<U>::value) {
+        char buffer[64];
+        std::to_chars_result result;
+        if constexpr (K == LogPlaceholderKind::HEXADECIMAL) result = std::to_chars(buffer, buffer+sizeof(buffer), value, 16);
+        else result = std::to_chars(buffer, buffer+sizeof(buffer), value);
+        text.append(buffer, static_cast<SizeType>(result.ptr-buffer));
+    } else if constexpr (is_log_string_v<U>) {
+        text.append(value);
+    } else {
+        LogTextStreamLease stream;
+        stream.stream() << value;
+        text.append(stream.take());
+    }
+}
+
+//! \brief A format parsed at compile time from the text given by \a S::value(), to be created with CONCLOG_FORMAT
+//! \details Placeholders are "{}" for any type, "{d}" and "{x}" for integers in decimal and hexadecimal, "{f}" for floating point
+//! numbers and "{s}" for characters and strings, while "{{" and "}}" stand for literal braces; other uses of "{" fail the build
+template<class S> class LogTypedFormat {
+  public:
+    static constexpr std::string_view text = S::value();
+    static constexpr SizeType num_segments = parse_log_format(text, nullptr);
+
+    static constexpr std::array<LogFormatSegment,num_segments> segments() {
+        std::array<LogFormatSegment,num_segments> result{};
+        parse_log_format(text, result.data());
+        return result;
+    }
+
+    static constexpr SizeType num_placeholders() {
+        SizeType result = 0;
+        for (auto const& segment : segments()) if (segment.placeholder != LogPlaceholderKind::NONE) ++result;
+        return result;
+    }
+
+    //! \brief The segment ending with the placeholder of index \a i, or the last segment if there are fewer placeholders
+    static constexpr SizeType placeholder_segment(SizeType i) {
+        auto s = segments();
+        for (SizeType j=0; j<num_segments; ++j) if (s[j].placeholder != LogPlaceholderKind::NONE and i-- == 0) return j;
+        return num_segments-1;
+    }
+
+    template<class... TS, SizeType... IS> static constexpr bool accepts(std::index_sequence<IS...>) {
+        // A different number of arguments is reported on its own
+        if (num_placeholders() != sizeof...(TS)) return true;
+        return (log_placeholder_accepts<TS>(segments()[placeholder_segment(IS)].placeholder) and ...);
+    }
+
+    //! \brief Overwrite \a result with the format where the placeholders are replaced by the \a args
+    template<class... TS> static void write(std::string& result, TS const&... args) {
+        static_assert(num_placeholders() == sizeof...(TS), "The number of arguments differs from the number of placeholders of the format");
+        static_assert(accepts<TS...>(std::index_sequence_for<TS...>()), "An argument does not match the type of its placeholder in the format");
+        result.clear();
+        _write(result, std::index_sequence_for<TS...>(), args...);
+    }
+
+  private:
+    template<class... TS, SizeType... IS> static void _write(std::string& result, std::index_sequence<IS...>, TS const&... args) {
+        SizeType next = 0;
+        (_write_argument<placeholder_segment(IS)>(result, next, args), ...);
+        _append_literals(result, next, num_segments);
+    }
+
+    template<SizeType J, class T> static void _write_argument(std::string& result, SizeType& next, T const& arg) {
+        _append_literals(result, next, J+1);
+        append_log_value<segments()[J].placeholder>(result, arg);
+    }
+
+    static void _append_literals(std::string& result, SizeType& next, SizeType end) {
+        static constexpr auto all_segments = segments();
+        for (; next<end; ++next) result.append(text.data()+all_segments[next].begin, all_segments[next].size);
+    }
+};
+
+class ScopeProfileNode;
+class TraceEventBuffer;
+
+//! \brief The identifier of a call site in the LogCallsiteRegistry, starting from 1, where 0 stands for no call site
+using LogCallsiteId = uint32_t;
+
+//! \brief The static description of the call site of a logging macro, registered when constructed
+//! \details Created once by each macro expansion, as a static object, when first reached; the \a format is the format
+//! of CONCLOG_PRINTLN_FMT and CONCLOG_PRINTLN_TYPED, or the text of the argument as written in the source for the other macros,
+//! and the \a level is the level increase of the first call. The identifier is attached to the messages in addition to their text:
+//! only CONCLOG_PRINTLN_FMT and CONCLOG_PRINTLN_TYPED keep their static text out of the queues, by enqueueing the format by pointer
+class LogCallsite {
+  public:
+    LogCallsite(char const* file, unsigned int line, char const* function, unsigned int level, char const* format);
+    LogCallsite(LogCallsite const&) = delete;
+    LogCallsite& operator=(LogCallsite const&) = delete;
+
+    LogCallsiteId id() const { return _id; }
+    char const* file() const { return _file; }
+    unsigned int line() const { return _line; }
+    char const* function() const { return _function; }
+    unsigned int level() const { return _level; }
+    char const* format() const { return _format; }
+
+    //! \brief Whether the macro does anything, checked before any other work
+    bool is_enabled() const { return _enabled.load(std::memory_order_relaxed); }
+    void set_enabled(bool b) { _enabled.store(b, std::memory_order_relaxed); }
+
+    //! \brief The verbosity given by the verbosity filters, cached when they change, or UNFILTERED to use the configured one
+    unsigned int verbosity() const { return _verbosity.load(std::memory_order_relaxed); }
+    static constexpr unsigned int UNFILTERED = static_cast<unsigned int>(-1);
+  private:
+    friend class LogCallsiteRegistry;
+    char const* const _file;
+    unsigned int const _line;
+    char const* const _function;
+    unsigned int const _level;
+    char const* const _format;
+    // Initialised before the identifier, since registering publishes the object
+    std::atomic<bool> _enabled;
+    std::atomic<unsigned int> _verbosity;
+    LogCallsiteId const _id;
+};
+
+//! \brief The format of a call site, from the first argument of CONCLOG_PRINTLN_FMT
+inline char const* log_callsite_format(char const* format) { return format; }
+//! \brief The format of a call site, from the first argument of CONCLOG_PRINTLN_TYPED
+template<class S> char const* log_callsite_format(LogTypedFormat<S> const&) { return LogTypedFormat<S>::text.data(); }
+
+//! \brief A verbosity for the call sites whose function or file matches the \a pattern,
+//! where '*' stands for any sequence of characters and '?' for any character
+struct LogVerbosityFilter {
+    std::string pattern;
+    unsigned int verbosity;
+};
+
+//! \brief Parse a comma-separated list of filters "pattern:verbosity", where the pattern "default" stands for the call sites
+//! matching no other pattern; whitespace around the items is ignored and the verbosity follows the last colon
+//! \throws LoggerInvalidVerbosityFiltersException if an item has no verbosity or an empty pattern
+std::vector<LogVerbosityFilter> parse_verbosity_filters(std::string const& filters);
+
+//! \brief The registry of all the call sites of the logging macros reached so far
+//! \details Call sites are never unregistered, since they are static objects
+class LogCallsiteRegistry {
+    friend class LogCallsite;
+    LogCallsiteRegistry() = default;
+  public:
+    static LogCallsiteRegistry& instance();
+    //! \brief The call sites, ordered by identifier
+    std::vector<LogCallsite*> callsites() const;
+    //! \brief The call site with the \a id, or nullptr if none
+    LogCallsite* callsite(LogCallsiteId id) const;
+    //! \brief Set the verbosity \a filters, where the first matching pattern applies, caching the result on all the call sites
+    //! \details Call sites registered later are filtered when registered
+    void set_verbosity_filters(std::vector<LogVerbosityFilter> const& filters);
+  private:
+    //! \brief Add the \a callsite, returning its identifier
+    LogCallsiteId _add(LogCallsite* callsite);
+    //! \brief The verbosity of the first filter matching the \a callsite, under the lock
+    unsigned int _filtered_verbosity(LogCallsite const& callsite) const;
+  private:
+    mutable std::mutex _mutex;
+    std::vector<LogCallsite*> _callsites;
+    std::vector<LogVerbosityFilter> _filters;
+};
+
+//! \brief Attributes the messages submitted by the current thread to a call site, for the lifetime of the object
+//! \details Created by the macros around a submission; the previous call site is restored on destruction, so that
+//! the messages submitted while evaluating the text of another one are attributed correctly
+class LogCallsiteMark {
+  public:
+    LogCallsiteMark(LogCallsite const& callsite);
+    ~LogCallsiteMark();
+    LogCallsiteMark(LogCallsiteMark const&) = delete;
+    LogCallsiteMark& operator=(LogCallsiteMark const&) = delete;
+  private:
+    LogCallsiteId const _previous;
+};
+
 //! \brief Support class for managing log level increase/decrease in a scope
 //! \details Since it is possible to capture the scope string of a function only, nested scopes in a function have the same scope string
 //! (but work as expected in terms of level management)
@@ -175,6 +541,38 @@ class LogScopeManager {
   private:
     std::string const _scope;
     unsigned int const _level_increase;
+    // Only used when profiling scopes
+    ScopeProfileNode* _profile_node;
+    std::chrono::steady_clock::time_point _profile_start;
+    // The trace buffer that received the begin event, if tracing
+    SharedPointer<TraceEventBuffer> _trace_buffer;
+};
+
+//! \brief A link in the chain of the scopes entered by a thread, from the innermost
+//! \details Links are immutable, hence shared by the contexts that capture them
+struct LogScopeChain {
+    LogScopeChain(std::string scope_, SharedPointer<LogScopeChain const> parent_) : scope(scope_), parent(parent_) { }
+    std::string const scope;
+    SharedPointer<LogScopeChain const> const parent;
+};
+
+//! \brief The logging context of a thread: level, chain of scopes and logical name
+//! \details Captured with Logger::current_context() and restored with a LogContextGuard, so that a task
+//! running on a different thread than the one that created it logs as if it had not been handed off.
+//! Capturing does not copy the scopes.
+class LogContext {
+    friend class Logger;
+  public:
+    unsigned int level() const;
+    std::string const& thread_name() const;
+    //! \brief The scopes entered, from the outermost
+    std::vector<std::string> scopes() const;
+  private:
+    LogContext(unsigned int level, std::string thread_name, SharedPointer<LogScopeChain const> scope_chain);
+  private:
+    unsigned int _level;
+    std::string _thread_name;
+    SharedPointer<LogScopeChain const> _scope_chain;
 };
 
 //! \brief Supported kinds of log messages
@@ -189,6 +587,9 @@ struct LogThinRawMessage {
     std::string scope;
     unsigned int level;
     std::string text;
+    std::chrono::system_clock::time_point timestamp; // The time of submission
+    std::chrono::steady_clock::time_point steady_timestamp; // The time of submission on a monotonic clock, for latencies
+    LogCallsiteId callsite; // Of the macro submitting the message, 0 if none
 
     RawMessageKind kind() const;
 };
@@ -208,16 +609,74 @@ enum class ThreadNamePrintingPolicy { NEVER, BEFORE, AFTER };
 
 OutputStream& operator<<(OutputStream& os, const ThreadNamePrintingPolicy& p);
 
+//! \brief The format of the output: TEXT for the terminal-oriented output, NDJSON for one JSON object per message
+enum class LogOutputFormat { TEXT, NDJSON };
+
+OutputStream& operator<<(OutputStream& os, const LogOutputFormat& f);
+
+//! \brief The escape codes of a TerminalTextTheme, built once when publishing a snapshot rather than for each styled character
+struct CompiledTerminalTextTheme {
+    bool has_style = false;
+    std::string level_number;
+    std::string level_shown_separator;
+    std::string level_hidden_separator;
+    std::string multiline_separator;
+    std::string at;
+    //! \brief The styled text of each character, that is its escape code, the character and the reset code, or empty if the theme does not style it
+    //! \details Digits and dots are styled as numbers only depending on the characters preceding them
+    std::array<std::string,256> characters;
+};
+
+//! \brief The values of a LoggerConfiguration at some point in time, never modified once published
+//! \details Also holds the escape codes of the theme and of the keywords, compiled from the theme and the custom keywords when published
+struct LoggerConfigurationSnapshot {
+    unsigned int verbosity;
+    std::string verbosity_filters;
+    bool indents_based_on_level;
+    bool prints_level_on_change_only;
+    bool prints_scope_entrance;
+    bool prints_scope_exit;
+    bool handles_multiline_output;
+    bool discards_newlines_and_indentation;
+    ThreadNamePrintingPolicy thread_name_printing_policy;
+    LogOutputFormat output_format;
+    unsigned int recorder_verbosity;
+    SizeType recorder_capacity;
+    bool profiles_scopes;
+    std::chrono::milliseconds statistics_summary_period;
+    bool traces_latency;
+    SizeType payload_chunk_size;
+
+    TerminalTextTheme theme;
+    std::map<std::string,TerminalTextStyle> custom_keywords;
+    //! \brief The escape codes of the theme
+    CompiledTerminalTextTheme theme_codes;
+    //! \brief The escape codes of the default keywords from the theme and of the custom keywords, where the default ones take precedence
+    std::map<std::string,std::string> keyword_styles;
+};
+
 //! \brief Configuration of visualisation settings for a Logger
+//! \details Safe to change while printing from any thread: each change publishes a new snapshot, which each thread
+//! caches and loads again only once a newer one is published. A snapshot is released as soon as no thread caches
+//! or holds it anymore.
 class LoggerConfiguration {
   public:
 
     LoggerConfiguration();
+    LoggerConfiguration(LoggerConfiguration const&) = delete;
+    LoggerConfiguration& operator=(LoggerConfiguration const&) = delete;
 
     //! \brief Configuration setters
 
     //! \brief The depth of printing, where v=0 prevents all printing
     void set_verbosity(unsigned int v);
+    //! \brief The depth of printing for the call sites of the macros matching the \a filters, e.g. "*Reachability*:7,default:2"
+    //! \details The filters are a comma-separated list of "pattern:verbosity", matched against the function or the file of the
+    //! call site with '*' and '?' as wildcards, where the first match applies and "default" applies to the call sites matching
+    //! no other pattern; the call sites matching none use the verbosity; an empty list removes the filters.
+    //! The verbosity of each call site is computed once and cached, hence the check when printing costs as without filters
+    //! \throws LoggerInvalidVerbosityFiltersException if malformed, leaving the filters unchanged
+    void set_verbosity_filters(std::string const& filters);
     //! \brief If true, indents each line with a number of spaces equal to the level
     void set_indents_based_on_level(bool b);
     //! \brief If false, the level is shown on each first line of a print; if true, only when a print has a different level
@@ -233,10 +692,33 @@ class LoggerConfiguration {
     //! \brief Decides if and where to append the thread name to the log level (if the latter is shown)
     //! \details The policy is implicitly NEVER if the scheduler is immediate, or only one thread is registered (logging thread excluded)
     void set_thread_name_printing_policy(ThreadNamePrintingPolicy p);
+    //! \brief The format of the output
+    //! \details With NDJSON, each message is written as a JSON object on a single line, with fields
+    //! timestamp (microseconds since epoch), thread, level, scope, callsite (the identifier in the LogCallsiteRegistry,
+    //! 0 if not submitted by a macro), kind and text; theme, indentation, multiline handling and held lines do not apply
+    void set_output_format(LogOutputFormat f);
+    //! \brief The depth of recording into the flight recorder of the lines muted by the verbosity, where v=0 disables recording
+    //! \details Only effective if larger than the verbosity; recorded lines are printed by Logger::dump_flight_recorder()
+    void set_recorder_verbosity(unsigned int v);
+    //! \brief The number of most recent lines retained by the flight recorder of each thread
+    //! \details Applies to the threads that start recording after the change
+    void set_recorder_capacity(SizeType c);
+    //! \brief If true, the time spent in each scope is measured and aggregated into a call tree for Logger::profile_report()
+    //! \details Applies to the scopes entered after the change
+    void set_profiles_scopes(bool b);
+    //! \brief The period for printing a summary line of the statistics, where zero disables it
+    //! \details The line is printed by the first thread printing after the period elapses
+    void set_statistics_summary_period(std::chrono::milliseconds p);
+    //! \brief If true, the time from the submission of each line to its writing is accumulated for Logger::latency_report()
+    void set_traces_latency(bool b);
+    //! \brief The size in bytes of the chunks allocated by the arena of each thread, which stores the queued text too long to be inline in the queue
+    //! \details Applies to the chunks allocated after the change; chunks are reused once their text has been written
+    void set_payload_chunk_size(SizeType s);
 
     //! \brief Configuration getters
 
     unsigned int verbosity() const;
+    std::string verbosity_filters() const;
     bool indents_based_on_level() const;
     bool prints_level_on_change_only() const;
     bool prints_scope_entrance() const;
@@ -244,11 +726,18 @@ class LoggerConfiguration {
     bool handles_multiline_output() const;
     bool discards_newlines_and_indentation() const;
     ThreadNamePrintingPolicy thread_name_printing_policy() const;
+    LogOutputFormat output_format() const;
+    unsigned int recorder_verbosity() const;
+    SizeType recorder_capacity() const;
+    bool profiles_scopes() const;
+    std::chrono::milliseconds statistics_summary_period() const;
+    bool traces_latency() const;
+    SizeType payload_chunk_size() const;
 
     //! \brief Style theme for terminal output
     void set_theme(TerminalTextTheme const& theme);
     //! \brief Get the current theme used
-    TerminalTextTheme const& theme() const;
+    TerminalTextTheme theme() const;
     //! \brief Add a keyword to the default ones offered, forcing a given style
     //! \details Adding an existing keyword has no effect
     void add_custom_keyword(std::string const& text, TerminalTextStyle const& style);
@@ -256,25 +745,50 @@ class LoggerConfiguration {
     //! \details Adding an existing keyword has no effect. Changing the theme will not apply to this custom keyword.
     void add_custom_keyword(std::string const& text);
     //! \brief Get the map of keywords (a TerminalTextStyle equal to TT_STYLE_NONE implies no custom style forced)
-    std::map<std::string,TerminalTextStyle> const& custom_keywords() const;
+    std::map<std::string,TerminalTextStyle> custom_keywords() const;
+
+    //! \brief The current values, which are consistent with each other and remain valid after later changes
+    SharedPointer<LoggerConfigurationSnapshot const> snapshot() const;
 
     friend OutputStream& operator<<(OutputStream& os, LoggerConfiguration const& configuration);
 
   private:
-    unsigned int _verbosity;
-    bool _indents_based_on_level;
-    bool _prints_level_on_change_only;
-    bool _prints_scope_entrance;
-    bool _prints_scope_exit;
-    bool _handles_multiline_output;
-    bool _discards_newlines_and_indentation;
-    ThreadNamePrintingPolicy _thread_name_printing_policy;
-
-    TerminalTextTheme _theme;
-    std::map<std::string,TerminalTextStyle> _custom_keywords;
+    //! \brief Publish a copy of the current snapshot changed by \a change, with the keyword styles compiled again
+    template<class F> void _update(F const& change);
+    //! \brief The current snapshot as cached by the calling thread, valid until the thread reads the configuration again
+    LoggerConfigurationSnapshot const& _cached_snapshot() const;
+  private:
+    // Only accessed with std::atomic_load and std::atomic_store
+    SharedPointer<LoggerConfigurationSnapshot const> _snapshot;
+    // Identifies the snapshot published, uniquely among all the configurations, so that threads know when to load it again
+    std::atomic<uint64_t> _version;
+    // Serialises the changes
+    std::mutex _update_mutex;
+};
+
+//! \brief A snapshot of the counters kept by the logger about itself, since its construction
+struct LoggerStatistics {
+    SizeType messages_enqueued = 0;
+    SizeType bytes_enqueued = 0; // Of the text only
+    SizeType messages_written = 0;
+    SizeType bytes_written = 0; // Of the text only
+    SizeType queue_depth = 0; // Summed over the threads
+    SizeType queue_high_water = 0; // The largest depth of a thread queue
+    std::chrono::nanoseconds producer_blocked_time = std::chrono::nanoseconds(0); // Waiting for locks held by other threads or the consumer
+    std::chrono::nanoseconds consumer_busy_time = std::chrono::nanoseconds(0);
+    std::chrono::nanoseconds consumer_idle_time = std::chrono::nanoseconds(0);
+    SizeType payload_chunks_allocated = 0; // By the arenas of the threads, for the queued text too long to be inline
+    SizeType payload_bytes_allocated = 0;
+    SizeType payload_chunks_reused = 0; // Taken from the free list of an arena instead of being allocated
 };
 
+//! \brief Print the statistics on a single line
+OutputStream& operator<<(OutputStream& os, LoggerStatistics const& s);
+
 class LoggerSchedulerInterface;
+class FlightRecorderRing;
+class LatencyHistogram;
+struct ThisThreadLoggerData;
 
 //! \brief A static class for log output handling.
 //! Configuration and final printing is done here, while scheduling is
@@ -284,6 +798,8 @@ class Logger {
     friend class ImmediateLoggerScheduler;
     friend class BlockingLoggerScheduler;
     friend class NonblockingLoggerScheduler;
+    friend class LogScopeManager;
+    friend struct ThisThreadLoggerData;
 
     Logger();
   public:
@@ -301,6 +817,9 @@ class Logger {
     //! \brief Check whether there is already a thread registry attached
     bool has_thread_registry_attached() const;
 
+    //! \brief Change the scheduler, also while threads are registered
+    //! \details The previous scheduler is drained and the level and name of each thread are transferred;
+    //! submissions from other threads are paused in the meantime
     void use_immediate_scheduler();
     void use_blocking_scheduler();
     void use_nonblocking_scheduler();
@@ -308,6 +827,9 @@ class Logger {
     void redirect_to_file(const char* filename);
     void redirect_to_console();
 
+    //! \brief Registers the thread with the given \a id and \a name, at the current level of the calling thread
+    //! \details Not necessary for logging, since a thread is registered automatically on its first call, with its id as name
+    //! and the base level, and unregistered at its exit; an explicit registration replaces the automatic one
     void register_thread(std::thread::id id, std::string name);
     void unregister_thread(std::thread::id id);
     //! \brief Registers this same thread with a specific \a name and \a level
@@ -315,9 +837,102 @@ class Logger {
     //! since the level cannot be obtained
     void register_self_thread(std::string name, unsigned int level);
 
-    void println(unsigned int level_increase, std::string text);
-    void hold(std::string scope, std::string text);
-    void release(std::string scope);
+    void println(unsigned int level_increase, std::string const& text);
+    //! \brief Print taking over the \a text, which is swapped with a string of the logger holding its capacity
+    //! \details Used by the macros to hand off the formatted text without copying it
+    void println(unsigned int level_increase, std::string&& text);
+    //! \brief Print the \a text, copied once into a string of the logger holding its capacity
+    void println(unsigned int level_increase, std::string_view text);
+    //! \brief Print a string literal, which the nonblocking scheduler enqueues by pointer without copying
+    //! \details The array must outlive the logger, as string literals do; arrays of non-constant characters are copied instead
+    template<SizeType N> void println(unsigned int level_increase, char const (&text)[N]) { _println_static(level_increase, text); }
+    template<SizeType N> void println(unsigned int level_increase, char (&text)[N]) { println(level_increase, std::string_view(text)); }
+    //! \brief Print a C string, copied once as for a string view
+    template<class C, std::enable_if_t<std::is_same<C,char const*>::value or std::is_same<C,char*>::value,int> = 0>
+    void println(unsigned int level_increase, C const& text) { println(level_increase, std::string_view(text)); }
+    void hold(std::string_view scope, std::string const& text);
+    //! \brief Hold taking over the \a text, as for println
+    void hold(std::string_view scope, std::string&& text);
+    //! \brief Hold the \a text, copied once as for println
+    void hold(std::string_view scope, std::string_view text);
+    template<SizeType N> void hold(std::string_view scope, char const (&text)[N]) { hold(scope, std::string_view(text)); }
+    template<class C, std::enable_if_t<std::is_same<C,char const*>::value or std::is_same<C,char*>::value,int> = 0>
+    void hold(std::string_view scope, C const& text) { hold(scope, std::string_view(text)); }
+    void release(std::string_view scope);
+    //! \brief Print \a format replacing each placeholder "{}" with the next of the \a args, which must be trivially copyable
+    //! \details The arguments are copied as bytes and written as text by the scheduler, hence by the consumption thread
+    //! for the nonblocking scheduler; the format and any C string argument must outlive the logger, as string literals do
+    template<class... TS> void println_format(unsigned int level_increase, char const* format, TS const&... args) {
+        static_assert((std::is_trivially_copyable<DeferredArgument<TS>>::value and ...), "Deferred format arguments must be trivially copyable");
+        thread_local std::string this_thread_arguments;
+        this_thread_arguments.resize((SizeType(0) + ... + sizeof(DeferredArgument<TS>)));
+        char* position = &this_thread_arguments[0];
+        ((position = write_deferred_argument<DeferredArgument<TS>>(position, args)), ...);
+        _println_deferred(level_increase, LogDeferredFormat{format, &write_deferred_format<DeferredArgument<TS>...>}, std::move(this_thread_arguments));
+    }
+    //! \brief Capture a muted line of println_format into the flight recorder of the current thread
+    template<class... TS> void record_format(unsigned int level_increase, char const* format, TS const&... args) {
+        LogTextStreamLease stream;
+        write_format(stream.stream(), format, args...);
+        record(level_increase, stream.take());
+    }
+    //! \brief Print the typed \a format, created by CONCLOG_FORMAT, with its placeholders replaced by the \a args
+    //! \details Literal segments are appended as they are and numbers are converted with std::to_chars, without streams
+    template<class F, class... TS> void println_typed(unsigned int level_increase, F const&, TS const&... args) {
+        thread_local std::string this_thread_text;
+        F::write(this_thread_text, args...);
+        println(level_increase, std::move(this_thread_text));
+    }
+    //! \brief Capture a muted line of println_typed into the flight recorder of the current thread
+    template<class F, class... TS> void record_typed(unsigned int level_increase, F const&, TS const&... args) {
+        thread_local std::string this_thread_text;
+        F::write(this_thread_text, args...);
+        record(level_increase, std::move(this_thread_text));
+    }
+    //! \brief Block until all the messages submitted before the call have been written
+    //! \details Also writes the buffered trace events, if tracing
+    void flush();
+    //! \brief Get a future that is ready when all the messages submitted before the call have been written
+    //! \details With the nonblocking scheduler, a marker is enqueued for each thread and the future is ready when the
+    //! consumption thread has dequeued all of them
+    std::future<void> flush_async();
+    //! \brief Capture a muted line into the flight recorder of the current thread
+    //! \details The \a text is swapped with the text previously held by the slot of the recorder, as taken from LogTextStreamLease
+    void record(unsigned int level_increase, std::string&& text);
+    void record(unsigned int level_increase, std::string_view text);
+
+    //! \brief Print all the lines captured by the flight recorders, ordered by time, and clear them
+    void dump_flight_recorder();
+
+    //! \brief Get the call tree of the profiled scopes, merged from all threads
+    //! \details For each scope: number of calls, total, self, minimum and maximum time, and a histogram
+    //! of the call counts per power of two of nanoseconds
+    std::string profile_report() const;
+
+    //! \brief Start tracing scopes, printed lines and counters into \a filename, in the trace event format of Chrome and Perfetto
+    //! \details Events are buffered by each thread in binary form and written only on flush() and stop_tracing();
+    //! each thread is shown as a track with its name
+    void trace_to_file(const char* filename);
+    //! \brief Write the buffered events and close the trace file
+    void stop_tracing();
+    bool is_tracing() const;
+    //! \brief Record a \a value on the counter track named \a name, e.g., the current value of a ProgressIndicator
+    void trace_counter(std::string const& name, double value);
+
+    //! \brief Get the counters kept about the logger itself
+    LoggerStatistics statistics() const;
+    //! \brief Get the counters of the current thread only, for the current scheduler
+    //! \details Only the producer fields are set, with the queue depth being the one of the thread
+    LoggerStatistics current_thread_statistics() const;
+
+    //! \brief Get the percentiles of the latency of the lines traced so far, per scheduler used and per thread
+    //! \details The latency is the time from the submission of a line to the end of its writing
+    std::string latency_report() const;
+
+    //! \brief Install handlers for fatal signals that write out the messages still enqueued and the flight recorder lines
+    //! \details Writing bypasses locks and formatting, using the raw form "thread@level| text"; the signal is then re-raised
+    //! with its default action. Not supported on Windows, where the call has no effect.
+    void install_fatal_signal_handlers();
 
     void increase_level(unsigned int i);
     void decrease_level(unsigned int i);
@@ -325,42 +940,158 @@ class Logger {
     void mute_decrease_level();
 
     bool is_muted_at(unsigned int i) const;
+    //! \brief Check whether the call site would print at the \a i increase, according to its filtered verbosity if any
+    bool is_muted_at(unsigned int i, LogCallsite const& callsite) const;
+    //! \brief Whether a muted line at the increased level would be captured by the flight recorder
+    bool is_recorded_at(unsigned int i) const;
+    bool is_recorded_at(unsigned int i, LogCallsite const& callsite) const;
+
+    //! \brief Override the verbosity for the thread with the given \a id, taking effect on its next line
+    //! \details The override applies in place of both the configured verbosity and the verbosity filters; it is kept
+    //! when changing scheduler, but with the immediate scheduler it applies to all threads since they share the same data
+    //! \throws LoggerUnknownThreadException if the thread is not registered
+    void set_thread_verbosity(std::thread::id id, unsigned int v);
+    //! \brief Override the verbosity for all the threads with the given \a name
+    //! \throws LoggerUnknownThreadException if no registered thread has the name
+    void set_thread_verbosity(std::string const& name, unsigned int v);
+    //! \brief Remove the override of the verbosity for the thread with the given \a id
+    void reset_thread_verbosity(std::thread::id id);
+    void reset_thread_verbosity(std::string const& name);
 
     unsigned int current_level() const;
+    //! \brief The logical name of the current thread, which is its registered name unless a context is restored
     std::string current_thread_name() const;
     std::string cached_last_printed_thread_name() const;
 
+    //! \brief Capture the context of the current thread
+    LogContext current_context() const;
+    //! \brief Replace the context of the current thread with \a context
+    //! \details The logical name applies to the messages submitted from now on, while the name the thread is
+    //! registered with is kept for thread verbosity overrides and scheduler changes
+    void restore_context(LogContext const& context);
+    //! \brief Replace the context of the current thread with \a context, saving the replaced one into \a previous
+    //! \details Meant for switching repeatedly between the same contexts: the parts unchanged are not copied, and
+    //! the scheduler is involved only when the logical name changes
+    void switch_context(LogContext const& context, LogContext& previous);
+
     unsigned int get_window_columns() const;
 
     LoggerConfiguration& configuration();
 
   private:
-    std::string _apply_theme(std::string const& text) const;
-    std::string _apply_theme_for_keywords(std::string const& text) const;
-    void _print_preamble_for_firstline(unsigned int level, std::string thread_name);
-    void _print_preamble_for_extralines(unsigned int level);
+    // The printing functions take the snapshot of the configuration obtained once for each message
+    std::string _apply_theme(LoggerConfigurationSnapshot const& configuration, std::string const& text) const;
+    std::string _apply_theme_for_keywords(LoggerConfigurationSnapshot const& configuration, std::string const& text) const;
+    void _print_preamble_for_firstline(LoggerConfigurationSnapshot const& configuration, unsigned int level, std::string const& thread_name);
+    void _print_preamble_for_extralines(LoggerConfigurationSnapshot const& configuration, unsigned int level);
     std::string _discard_newlines_and_indentation(std::string const& text);
+    //! \brief Print \a count characters of \a text from \a pos, applying the theme if any
+    void _print_with_theme(LoggerConfigurationSnapshot const& configuration, std::string const& text, SizeType pos, SizeType count) const;
     void _cover_held_columns_with_whitespaces(unsigned int printed_columns);
-    void _print_held_line();
+    void _print_held_line(LoggerConfigurationSnapshot const& configuration);
     void _println(LogRawMessage const& msg);
+    void _println_deferred(unsigned int level_increase, LogDeferredFormat const& format, std::string&& arguments);
+    //! \brief Print the null-terminated \a text, which outlives the logger
+    void _println_static(unsigned int level_increase, char const* text);
     void _hold(LogRawMessage const& msg);
     void _release(LogRawMessage const& msg);
+    void _print_ndjson(LogRawMessage const& msg);
     bool _is_holding() const;
-    bool _can_print_thread_name() const;
+    bool _can_print_thread_name(LoggerConfigurationSnapshot const& configuration) const;
+    static void _handle_fatal_signal(int signal_number);
+    void _use_scheduler(SharedPointer<LoggerSchedulerInterface> scheduler);
+    //! \brief The scheduler whose messages are written by the current thread, which may be a previous one being drained
+    LoggerSchedulerInterface const& _writing_scheduler() const;
+    //! \brief The flight recorder of the current thread, created and registered on first use
+    FlightRecorderRing& _this_thread_flight_recorder_ring();
+    //! \brief Get the data of the current thread for the \a scheduler, registering the thread if unknown
+    //! \details The scheduler mutex must be held
+    LoggerData& _this_thread_data(LoggerSchedulerInterface* scheduler) const;
+    //! \brief Get the data of the current thread for the current scheduler, cached after the first call
+    LoggerData& _this_thread_data() const;
+    //! \brief The verbosity for the thread of \a data: its override if any, otherwise the \a filtered_verbosity of a call site if not
+    //! LogCallsite::UNFILTERED, otherwise the configured one
+    unsigned int _verbosity_of(LoggerData const& data, unsigned int filtered_verbosity) const;
+    void _register_thread(LoggerSchedulerInterface* scheduler, std::thread::id id, std::string name, unsigned int level);
+    void _unregister_automatically_registered_thread();
+    //! \brief Get the trace buffer of the current thread for the current tracing session
+    SharedPointer<TraceEventBuffer> const& _this_thread_trace_buffer();
+    void _write_trace_events();
+    void _print_statistics_summary_if_due();
+    void _record_latency(LogRawMessage const& msg);
   private:
     static const unsigned int _MUTE_LEVEL_OFFSET;
     static const std::string _MAIN_THREAD_NAME;
     std::ofstream _redirect_file;
+    std::string _redirect_filename;
     std::basic_streambuf<char>* _default_streambuf;
     std::vector<LogRawMessage> _current_held_stack;
     unsigned int _cached_num_held_columns;
     unsigned int _cached_last_printed_level;
     std::string _cached_last_printed_thread_name;
-    std::shared_ptr<LoggerSchedulerInterface> _scheduler;
+    // The current scheduler, whose raw pointer is also available without locking
+    SharedPointer<LoggerSchedulerInterface> _scheduler_instance;
+    std::atomic<LoggerSchedulerInterface*> _scheduler;
+    // Incremented on each change of scheduler, to invalidate the data cached by threads
+    std::atomic<unsigned int> _scheduler_generation;
+    // Shared by submissions and level changes, exclusive when changing scheduler
+    mutable std::shared_mutex _scheduler_mutex;
+    // Serialises the changes of scheduler, since the previous one is drained without holding the scheduler mutex
+    std::mutex _scheduler_change_mutex;
+    // The previous scheduler while it is drained, then released once its counters are retired
+    SharedPointer<LoggerSchedulerInterface> _draining_scheduler;
+    LoggerStatistics _retired_statistics;
+    mutable std::mutex _retired_statistics_mutex;
+    // Serialises writing, since the previous scheduler may be draining while the current one writes
+    std::mutex _output_mutex;
     ThreadRegistryInterface* _thread_registry;
+    mutable std::set<std::thread::id> _automatically_registered_threads;
+    mutable std::mutex _automatically_registered_threads_mutex;
     LoggerConfiguration _configuration;
+    std::vector<SharedPointer<FlightRecorderRing>> _flight_recorder_rings;
+    std::mutex _flight_recorder_mutex;
+    std::vector<SharedPointer<ScopeProfileNode>> _profile_roots;
+    mutable std::mutex _profile_mutex;
+    std::atomic<bool> _is_tracing;
+    std::ofstream _trace_file;
+    std::chrono::steady_clock::time_point _trace_start;
+    std::atomic<unsigned int> _trace_session;
+    unsigned int _num_traced_threads;
+    std::vector<SharedPointer<TraceEventBuffer>> _trace_buffers;
+    std::mutex _trace_mutex;
+    // In nanoseconds of the steady clock, zero until a period is set
+    std::atomic<int64_t> _next_statistics_summary;
+    // Keyed by the kind of scheduler, accumulating over all the schedulers of that kind
+    std::map<std::string,SharedPointer<LatencyHistogram>> _scheduler_latencies;
+    std::map<std::string,SharedPointer<LatencyHistogram>> _thread_latencies;
+    mutable std::mutex _latency_mutex;
 };
 
+//! \brief Restores a context in the current thread for the lifetime of the object, then restores the previous one
+class LogContextGuard {
+  public:
+    LogContextGuard(LogContext const& context);
+    LogContextGuard(LogContextGuard const&) = delete;
+    void operator=(LogContextGuard const&) = delete;
+    ~LogContextGuard();
+  private:
+    LogContext const _previous_context;
+};
+
+//! \brief Wrap the function \a f so that it is called within the context of the wrapping thread
+//! \details Meant for submitting tasks to custom executors and thread pools
+template<class F> auto with_log_context(F&& f) {
+    return [context = Logger::instance().current_context(), f = std::forward<F>(f)](auto&&... args) mutable -> decltype(auto) {
+        LogContextGuard guard(context);
+        return f(std::forward<decltype(args)>(args)...);
+    };
+}
+
+//! \brief Run the function \a f with std::async, within the context of the calling thread
+template<class F, class... AS> auto async_with_log_context(std::launch policy, F&& f, AS&&... args) {
+    return std::async(policy, with_log_context(std::forward<F>(f)), std::forward<AS>(args)...);
+}
+
 } // namespace ConcLog
 
 #endif // CONCLOGGING_HPP
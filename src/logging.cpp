@@ -26,6 +26,11 @@
  * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+// The free functions for atomic access to a shared_ptr are deprecated by C++20, which Windows builds use
+#if defined(_MSC_VER) && !defined(_SILENCE_CXX20_OLD_SHARED_PTR_ATOMIC_SUPPORT_DEPRECATION_WARNING)
+#define _SILENCE_CXX20_OLD_SHARED_PTR_ATOMIC_SUPPORT_DEPRECATION_WARNING
+#endif
+
 #include <iostream>
 #include <cassert>
 #include <thread>
@@ -33,10 +38,21 @@
 #include <mutex>
 #include <atomic>
 #include <functional>
+#include <shared_mutex>
+#include <charconv>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <iomanip>
+#include <cstdio>
+#include <cmath>
+#include <unordered_map>
 
 #ifndef _WIN32
 #include <sys/ioctl.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <csignal>
 #endif
 
 #include "logging.hpp"
@@ -61,6 +77,7 @@ TerminalTextStyle::TerminalTextStyle(uint8_t fontcolor_, uint8_t bgcolor_, bool
 { }
 
 std::string TerminalTextStyle::operator()() const {
+    if (not is_styled()) return std::string();
     std::ostringstream ss;
     if (((int)fontcolor) > 0) ss << "\u001b[38;5;" << (int)fontcolor << "m";
     if (((int)bgcolor) > 0) ss << "\u001b[48;5;" << (int)bgcolor << "m";
@@ -114,44 +131,808 @@ OutputStream& operator<<(OutputStream& os, TerminalTextTheme const& theme) {
     return os;
 }
 
-//! \brief Thread-based enqueued log data
+//! \brief A barrier that completes when all of its markers have been dequeued
+//! \details Markers are dequeued by the consumption thread only, which also flushes the output on completion
+class FlushBarrier {
+  public:
+    FlushBarrier(SizeType num_markers) : _remaining_markers(num_markers) { }
+    std::future<void> future() { return _promise.get_future(); }
+    void arrive() {
+        if (--_remaining_markers == 0) {
+            std::clog << std::flush;
+            _promise.set_value();
+        }
+    }
+  private:
+    SizeType _remaining_markers;
+    std::promise<void> _promise;
+};
+
+//! \brief Increase a counter that is written under a lock but read at any time
+template<class T> void add_to_counter(std::atomic<T>& counter, T value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+//! \brief A chunk of the storage of a payload arena, linked to the next chunk of the same text or of the free list
+struct LogPayloadChunk {
+    explicit LogPayloadChunk(SizeType capacity_) : next(nullptr), size(0), capacity(capacity_), data(new char[capacity_]) { }
+    LogPayloadChunk* next;
+    SizeType size;
+    SizeType const capacity;
+    std::unique_ptr<char[]> const data;
+};
+
+//! \brief The storage of a thread for the queued text too long to be inline in the queue, as chains of chunks
+//! \details The chains are returned in bulk to the free list when dequeued, hence chunks are allocated only while the
+//! arena grows, always by the thread owning it, and never freed by another thread while in use; access is under the queue lock
+class LogPayloadArena {
+  public:
+    LogPayloadArena() : _free(nullptr), _num_chunks_allocated(0), _num_bytes_allocated(0), _num_chunks_reused(0) { }
+    LogPayloadArena(LogPayloadArena const&) = delete;
+    LogPayloadArena& operator=(LogPayloadArena const&) = delete;
+
+    //! \brief Copy the \a text into a chain of chunks, allocating chunks of \a chunk_size bytes when none is free
+    LogPayloadChunk* store(std::string_view text, SizeType chunk_size) {
+        LogPayloadChunk* head = nullptr;
+        LogPayloadChunk** tail = &head;
+        for (SizeType pos = 0; pos < text.size(); ) {
+            auto chunk = _acquire(chunk_size);
+            chunk->size = std::min(chunk->capacity, text.size()-pos);
+            std::memcpy(chunk->data.get(), text.data()+pos, chunk->size);
+            pos += chunk->size;
+            *tail = chunk;
+            tail = &chunk->next;
+        }
+        *tail = nullptr;
+        return head;
+    }
+    //! \brief Return the whole \a chain to the free list
+    void reclaim(LogPayloadChunk* chain) {
+        if (chain == nullptr) return;
+        auto last = chain;
+        while (last->next != nullptr) last = last->next;
+        last->next = _free;
+        _free = chain;
+    }
+    void add_statistics(LoggerStatistics& statistics) const {
+        statistics.payload_chunks_allocated += _num_chunks_allocated.load(std::memory_order_relaxed);
+        statistics.payload_bytes_allocated += _num_bytes_allocated.load(std::memory_order_relaxed);
+        statistics.payload_chunks_reused += _num_chunks_reused.load(std::memory_order_relaxed);
+    }
+  private:
+    LogPayloadChunk* _acquire(SizeType chunk_size) {
+        if (_free != nullptr) {
+            auto chunk = _free;
+            _free = chunk->next;
+            add_to_counter(_num_chunks_reused, SizeType(1));
+            return chunk;
+        }
+        _chunks.push_back(std::make_unique<LogPayloadChunk>(std::max(chunk_size, MINIMUM_CHUNK_SIZE)));
+        add_to_counter(_num_chunks_allocated, SizeType(1));
+        add_to_counter(_num_bytes_allocated, _chunks.back()->capacity);
+        return _chunks.back().get();
+    }
+  private:
+    static constexpr SizeType MINIMUM_CHUNK_SIZE = 64;
+    // Owns all the chunks, either free or in a chain held by a queue slot
+    std::vector<std::unique_ptr<LogPayloadChunk>> _chunks;
+    LogPayloadChunk* _free;
+    // Written under the queue lock, read by statistics at any time
+    std::atomic<SizeType> _num_chunks_allocated;
+    std::atomic<SizeType> _num_bytes_allocated;
+    std::atomic<SizeType> _num_chunks_reused;
+};
+
+//! \brief The text of a queue slot, stored inline if short enough, otherwise as a chain of chunks of the payload arena of the thread
+class LogSlotText {
+  public:
+    // Such that a queue entry takes exactly five cache lines, as checked after LogQueueEntry
+    static const SizeType INLINE_CAPACITY = 184;
+    LogSlotText() : _size(0), _chain(nullptr) { }
+    SizeType size() const { return _size; }
+    bool empty() const { return _size == 0; }
+    //! \brief Clear the text, which must have been moved out if stored in the arena
+    void clear() { _size = 0; }
+    void assign(std::string_view text, LogPayloadArena& arena, SizeType chunk_size) {
+        if (text.size() <= INLINE_CAPACITY) std::memcpy(_inline, text.data(), text.size());
+        else _chain = arena.store(text, chunk_size);
+        _size = text.size();
+    }
+    //! \brief Move the text into \a result, returning its chunks to the \a arena
+    void move_to(std::string& result, LogPayloadArena& arena) {
+        result.clear();
+        for_each_piece([&result](char const* data, SizeType size) { result.append(data, size); });
+        arena.reclaim(_chain);
+        _chain = nullptr;
+        _size = 0;
+    }
+    //! \brief Call \a f on the consecutive pieces of the text, as a pointer and a size
+    template<class F> void for_each_piece(F const& f) const {
+        if (_size <= INLINE_CAPACITY) f(_inline, _size);
+        else for (auto chunk = _chain; chunk != nullptr; chunk = chunk->next) f(chunk->data.get(), chunk->size);
+    }
+  private:
+    char _inline[INLINE_CAPACITY];
+    SizeType _size;
+    LogPayloadChunk* _chain;
+};
+
+//! \brief The size of a cache line, to which queue slots are aligned
+const SizeType CACHE_LINE_SIZE = 64;
+
+//! \brief An entry of a thread queue: either a message, a marker for a flush barrier, or a change of the thread name
+//! \details Entries have a fixed size and are aligned to cache lines, with the text of the message inline unless long,
+//! so that the consumption thread walks a queue linearly without reaching for scattered allocations
+struct alignas(CACHE_LINE_SIZE) LogQueueEntry {
+    LogQueueEntry() : level(0), callsite(0), deferred_format{nullptr,nullptr} { }
+    bool is_message() const { return barrier == nullptr and new_thread_name.empty(); }
+    //! \brief If the text of the message holds the arguments of the deferred format, copied as bytes
+    bool is_deferred() const { return deferred_format.write != nullptr; }
+    bool is_release() const { return not scope.empty() and text.empty(); }
+    unsigned int level;
+    LogCallsiteId callsite;
+    std::chrono::system_clock::time_point timestamp; // The time of submission
+    std::chrono::steady_clock::time_point steady_timestamp; // The time of submission on a monotonic clock, for latencies
+    LogDeferredFormat deferred_format;
+    LogSlotText text;
+    std::string scope;
+    SharedPointer<FlushBarrier> barrier;
+    std::string new_thread_name;
+};
+
+// The inline capacity of the text is tuned for this size, which the alignment alone does not guarantee, since any
+// new field would add a whole cache line; the debug iterators of MSVC enlarge the strings, hence the check is skipped there
+#if !defined(_ITERATOR_DEBUG_LEVEL) || _ITERATOR_DEBUG_LEVEL == 0
+static_assert(sizeof(LogQueueEntry) == 5*CACHE_LINE_SIZE, "A queue entry must take exactly five cache lines");
+#endif
+
+//! \brief A queue of entries stored in a ring of slots, which grows when full
+//! \details Slots are overwritten in place and swapped out when dequeued, hence the capacity of their strings is reused
+//! and a steady flow of messages of bounded size does not allocate
+class LogQueueRing {
+  public:
+    LogQueueRing() : _slots(INITIAL_CAPACITY), _head(0), _size(0) { }
+    SizeType size() const { return _size; }
+    bool empty() const { return _size == 0; }
+    //! \brief Add a slot at the back, holding stale content: the barrier and thread name must always be overwritten, the message only for messages
+    LogQueueEntry& push_back() {
+        if (_size == _slots.size()) _grow();
+        auto& slot = _slots[(_head+_size)%_slots.size()];
+        ++_size;
+        return slot;
+    }
+    LogQueueEntry& front() { return _slots[_head]; }
+    void pop_front() {
+        _head = (_head+1)%_slots.size();
+        --_size;
+    }
+    template<class F> void for_each(F const& f) const {
+        for (SizeType i=0; i<_size; ++i) f(_slots[(_head+i)%_slots.size()]);
+    }
+  private:
+    void _grow() {
+        std::vector<LogQueueEntry> slots(2*_slots.size());
+        for (SizeType i=0; i<_size; ++i) slots[i] = std::move(_slots[(_head+i)%_slots.size()]);
+        _slots.swap(slots);
+        _head = 0;
+    }
+  private:
+    static const SizeType INITIAL_CAPACITY = 16;
+    std::vector<LogQueueEntry> _slots;
+    SizeType _head;
+    SizeType _size;
+};
+
+// The call site of the messages submitted by the thread, set by LogCallsiteMark
+thread_local LogCallsiteId this_thread_callsite = 0;
+
+//! \brief Overwrite \a msg in place, to reuse the capacity of its strings, taking over the \a text by swapping
+void assign_message(LogRawMessage& msg, std::string const& identifier, std::string_view scope, unsigned int level, std::string&& text) {
+    msg.identifier.assign(identifier);
+    msg.scope.assign(scope);
+    msg.level = level;
+    msg.text.swap(text);
+    msg.timestamp = std::chrono::system_clock::now();
+    msg.steady_timestamp = std::chrono::steady_clock::now();
+    msg.callsite = this_thread_callsite;
+}
+
+//! \brief Overwrite \a msg in place, as above, copying the \a text
+void assign_message(LogRawMessage& msg, std::string const& identifier, std::string_view scope, unsigned int level, std::string_view text) {
+    msg.identifier.assign(identifier);
+    msg.scope.assign(scope);
+    msg.level = level;
+    msg.text.assign(text);
+    msg.timestamp = std::chrono::system_clock::now();
+    msg.steady_timestamp = std::chrono::steady_clock::now();
+    msg.callsite = this_thread_callsite;
+}
+
+
+//! \brief Write into \a text the \a format with the \a arguments, taking the result over from a reusable stream
+//! \details The \a text and the \a arguments may be the same string
+void write_deferred_text(std::string& text, LogDeferredFormat const& format, std::string const& arguments) {
+    LogTextStreamLease stream;
+    format.write(stream.stream(), format.format, arguments.data());
+    std::string&& result = stream.take();
+    text.swap(result);
+}
+
+//! \brief Lock the \a mutex, adding the time waited to \a blocked_ns only if it is contended
+std::unique_lock<std::mutex> lock_accounting_contention(std::mutex& mutex, std::atomic<uint64_t>& blocked_ns) {
+    std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+    if (not lock.owns_lock()) {
+        auto start = std::chrono::steady_clock::now();
+        lock.lock();
+        add_to_counter(blocked_ns, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-start).count()));
+    }
+    return lock;
+}
+
+//! \brief Thread-based log data, with the messages enqueued when the scheduler is not immediate
 class LoggerData {
+    friend class Logger;
+    friend class ImmediateLoggerScheduler;
+    friend class BlockingLoggerScheduler;
     friend class NonblockingLoggerScheduler;
 protected:
     LoggerData(unsigned int current_level, std::string const& thread_name);
 
-    void enqueue_println(unsigned int level_increase, std::string text);
-    void enqueue_hold(std::string scope, std::string text);
-    void enqueue_release(std::string scope);
-
-    LogThinRawMessage dequeue();
+    void enqueue_println(unsigned int level_increase, std::string_view text);
+    //! \brief Enqueue the null-terminated \a text by pointer, as a deferred format with no arguments
+    void enqueue_println_static(unsigned int level_increase, std::string_view text);
+    void enqueue_println_deferred(unsigned int level_increase, LogDeferredFormat const& format, std::string_view arguments);
+    void enqueue_hold(std::string_view scope, std::string_view text);
+    void enqueue_release(std::string_view scope);
+    void enqueue_barrier(SharedPointer<FlushBarrier> barrier);
+    //! \brief Change the logical name, for the messages enqueued from now on
+    void enqueue_logical_name(std::string logical_name);
+
+    //! \brief Remove the oldest entry, applying it if it changes the thread name
+    //! \details A message is moved into \a msg and \a deferred_format, a flush barrier into \a barrier
+    //! \return Whether the entry is a message
+    bool dequeue(LogThinRawMessage& msg, LogDeferredFormat& deferred_format, SharedPointer<FlushBarrier>& barrier);
 
     void increase_level(unsigned int i);
     void decrease_level(unsigned int i);
 
+    //! \brief The verbosity for the thread in place of the configured one, or NO_VERBOSITY_OVERRIDE
+    unsigned int verbosity_override() const;
+    void set_verbosity_override(unsigned int v);
+    static constexpr unsigned int NO_VERBOSITY_OVERRIDE = static_cast<unsigned int>(-1);
+
     //! \brief Set the object to be removed as soon as empty because it's detached from its thread
     void kill();
     //! \brief Notifies if the related thread has been joined and the object can be safely removed as soon as empty
     bool is_dead() const;
+    //! \brief Reuse a dead object for a new thread with the same id, keeping the messages not dequeued yet
+    void revive(unsigned int current_level, std::string const& thread_name);
 
     unsigned int current_level() const;
-    std::string thread_name() const;
+    //! \brief The name the thread is registered with
+    std::string const& thread_name() const;
+    //! \brief The name the messages submitted from now on are attributed to, which is the registered one unless changed by a context
+    std::string const& logical_name() const;
+    //! \brief The thread name for the messages to be dequeued next
+    std::string const& dequeued_thread_name() const;
 
     SizeType queue_size() const;
+
+    //! \brief Count a submission of a message with \a bytes of text, under a lock
+    void count_submission(SizeType bytes);
+    //! \brief Add the counters to \a statistics, excluding the queue depth
+    void add_statistics(LoggerStatistics& statistics) const;
+
+    //! \brief Write the enqueued messages to the file descriptor \a fd, without locking
+    //! \details Meant to be called only from a signal handler
+    void emergency_write(int fd) const;
 private:
     unsigned int _current_level;
+    // Next to the level, since both are read when checking whether a line is muted; written by any thread
+    std::atomic<unsigned int> _verbosity_override;
     std::string _thread_name;
-    std::queue<LogThinRawMessage> _raw_messages;
+    // Written by the owner thread only, under the queue mutex
+    std::string _logical_name;
+    // Changed by the consumption thread when dequeueing a change of name, under the data mutex of the scheduler
+    std::string _dequeued_thread_name;
+    LogQueueRing _raw_messages;
+    // Stores the text of the queued messages too long to be inline, under the queue mutex
+    LogPayloadArena _payload_arena;
+    // Written under the queue mutex, but read by the consumption thread without it
+    std::atomic<SizeType> _queue_size;
     std::mutex _queue_mutex;
-    bool _is_dead;
+    // Written by the unregistering thread, read by the owner thread to invalidate its cached reference
+    std::atomic<bool> _is_dead;
+    // Written under a lock, read by statistics at any time
+    std::atomic<SizeType> _num_submitted;
+    std::atomic<SizeType> _num_submitted_bytes;
+    std::atomic<SizeType> _queue_high_water;
+    std::atomic<uint64_t> _blocked_ns;
+
+    //! \brief Lock the queue, accounting for the time blocked
+    std::unique_lock<std::mutex> _lock_queue();
+    //! \brief Update the queue size after a change, under the queue lock
+    void _update_queue_size();
+    //! \brief Enqueue a message, under the queue lock
+    LogQueueEntry& _push_message(std::string_view scope, unsigned int level, std::string_view text);
+};
+
+// Write the data using async-signal-safe calls only
+void emergency_write(int fd, char const* data, SizeType size) {
+#ifndef _WIN32
+    while (size > 0) {
+        auto written = ::write(fd, data, size);
+        if (written <= 0) return;
+        data += written;
+        size -= static_cast<SizeType>(written);
+    }
+#else
+    (void)fd; (void)data; (void)size;
+#endif
+}
+
+// Write the "thread@level| " prefix of a message in raw form using async-signal-safe calls only
+void emergency_write_prefix(int fd, std::string const& thread_name, unsigned int level) {
+    char buffer[16];
+    SizeType pos = sizeof(buffer);
+    buffer[--pos] = ' ';
+    buffer[--pos] = '|';
+    do { buffer[--pos] = static_cast<char>('0' + level % 10); level /= 10; } while (level > 0);
+    buffer[--pos] = '@';
+    emergency_write(fd, thread_name.data(), thread_name.size());
+    emergency_write(fd, buffer+pos, sizeof(buffer)-pos);
+}
+
+// Write a message in the raw form "thread@level| text" using async-signal-safe calls only
+void emergency_write_message(int fd, std::string const& thread_name, unsigned int level, char const* text, SizeType size) {
+    emergency_write_prefix(fd, thread_name, level);
+    emergency_write(fd, text, size);
+    emergency_write(fd, "\n", 1);
+}
+
+void emergency_write_message(int fd, std::string const& thread_name, unsigned int level, LogSlotText const& text) {
+    emergency_write_prefix(fd, thread_name, level);
+    text.for_each_piece([fd](char const* data, SizeType size) { emergency_write(fd, data, size); });
+    emergency_write(fd, "\n", 1);
+}
+
+void emergency_write_message(int fd, std::string const& thread_name, unsigned int level, std::string const& text) {
+    emergency_write_message(fd, thread_name, level, text.data(), text.size());
+}
+
+//! \brief A line of a FlightRecorderRing, whose state hands it over between the recording thread and a dump
+struct FlightRecorderSlot {
+    enum State : unsigned char { EMPTY, WRITING, FULL, READING };
+    FlightRecorderSlot() : state(EMPTY), message(std::string(),0,std::string()) { }
+    std::atomic<State> state;
+    LogThinRawMessage message;
+};
+
+//! \brief Fixed-capacity ring of the most recent lines recorded by a thread
+//! \details Only the owner thread records, without locking: a slot is claimed with a compare-and-swap, which fails
+//! only while a dump is copying that same slot. The text of a slot keeps its capacity across records
+class FlightRecorderRing {
+  public:
+    FlightRecorderRing(std::string const& thread_name, SizeType capacity);
+
+    //! \brief Record the \a text by swapping it with the text of the slot, which is returned through \a text
+    void record(unsigned int level, std::string& text);
+    void record(unsigned int level, std::string_view text);
+    //! \brief Copy the recorded lines, from the oldest, into \a messages, emptying the slots
+    //! \details Lines being recorded meanwhile are left for the next extraction
+    void extract(std::vector<LogRawMessage>& messages);
+    //! \brief Write the recorded lines to the file descriptor \a fd, without claiming the slots
+    //! \details Meant to be called only from a signal handler
+    void emergency_write(int fd) const;
+  private:
+    //! \brief Claim the next slot for writing
+    FlightRecorderSlot& _begin_record(unsigned int level);
+    //! \brief Publish the slot claimed and advance to the next one
+    void _end_record(FlightRecorderSlot& slot);
+  private:
+    std::string const _thread_name;
+    std::unique_ptr<FlightRecorderSlot[]> _slots;
+    SizeType const _capacity;
+    // Written by the owner thread only, read by dumps to start from the oldest line
+    std::atomic<SizeType> _next;
+};
+
+FlightRecorderRing::FlightRecorderRing(std::string const& thread_name, SizeType capacity)
+    : _thread_name(thread_name), _slots(new FlightRecorderSlot[std::max(capacity,SizeType(1))]), _capacity(std::max(capacity,SizeType(1))), _next(0)
+{ }
+
+FlightRecorderSlot& FlightRecorderRing::_begin_record(unsigned int level) {
+    auto& slot = _slots[_next.load(std::memory_order_relaxed)];
+    auto state = slot.state.load(std::memory_order_relaxed);
+    while (true) {
+        // A dump copies a single line, hence waiting for it is brief
+        if (state == FlightRecorderSlot::READING) {
+            std::this_thread::yield();
+            state = slot.state.load(std::memory_order_relaxed);
+        } else if (slot.state.compare_exchange_weak(state, FlightRecorderSlot::WRITING, std::memory_order_acquire, std::memory_order_relaxed)) break;
+    }
+    slot.message.level = level;
+    slot.message.timestamp = std::chrono::system_clock::now();
+    return slot;
+}
+
+void FlightRecorderRing::_end_record(FlightRecorderSlot& slot) {
+    slot.state.store(FlightRecorderSlot::FULL, std::memory_order_release);
+    _next.store((_next.load(std::memory_order_relaxed)+1) % _capacity, std::memory_order_release);
+}
+
+void FlightRecorderRing::record(unsigned int level, std::string& text) {
+    auto& slot = _begin_record(level);
+    slot.message.text.swap(text);
+    _end_record(slot);
+}
+
+void FlightRecorderRing::record(unsigned int level, std::string_view text) {
+    auto& slot = _begin_record(level);
+    slot.message.text.assign(text.data(), text.size());
+    _end_record(slot);
+}
+
+void FlightRecorderRing::extract(std::vector<LogRawMessage>& messages) {
+    auto start = _next.load(std::memory_order_acquire);
+    for (SizeType i=0; i<_capacity; ++i) {
+        auto& slot = _slots[(start+i) % _capacity];
+        auto state = FlightRecorderSlot::FULL;
+        if (not slot.state.compare_exchange_strong(state, FlightRecorderSlot::READING, std::memory_order_acquire, std::memory_order_relaxed)) continue;
+        // Copied rather than moved, so that the text keeps its capacity for the next records
+        messages.push_back(LogRawMessage(_thread_name,slot.message));
+        slot.state.store(FlightRecorderSlot::EMPTY, std::memory_order_release);
+    }
+}
+
+void FlightRecorderRing::emergency_write(int fd) const {
+    auto start = _next.load(std::memory_order_relaxed);
+    for (SizeType i=0; i<_capacity; ++i) {
+        auto const& slot = _slots[(start+i) % _capacity];
+        if (slot.state.load(std::memory_order_relaxed) == FlightRecorderSlot::FULL)
+            emergency_write_message(fd,_thread_name,slot.message.level,slot.message.text);
+    }
+}
+
+thread_local SharedPointer<FlightRecorderRing> this_thread_flight_recorder_ring;
+
+//! \brief The data of the current thread, cached for the scheduler that provided it
+//! \details If the thread had to be registered automatically, it is unregistered at its exit
+struct ThisThreadLoggerData {
+    ~ThisThreadLoggerData();
+    // The generation of the scheduler owning the data, zero before the first use
+    unsigned int scheduler_generation = 0;
+    SharedPointer<LoggerData> data;
+    bool is_automatically_registered = false;
 };
 
+thread_local ThisThreadLoggerData this_thread_logger_data;
+
+// Set while the Logger instance exists; constant-initialised and trivially destructible, so that it can be read after static destruction
+std::atomic<bool> is_logger_alive(false);
+
+ThisThreadLoggerData::~ThisThreadLoggerData() {
+    // A thread exiting after the Logger is destroyed has nothing to unregister from
+    if (is_automatically_registered and is_logger_alive.load()) Logger::instance()._unregister_automatically_registered_thread();
+}
+
+//! \brief The aggregated times of a scope within the call tree of a thread
+//! \details Updated by its thread only and read by reports at any time, hence with relaxed atomics and no lock;
+//! children are prepended and never removed
+class ScopeProfileNode {
+  public:
+    static const SizeType NUM_HISTOGRAM_BUCKETS = 48;
+
+    ScopeProfileNode(std::string const& scope, ScopeProfileNode* parent);
+    ~ScopeProfileNode();
+
+    //! \brief Get the child for \a scope, creating it if missing
+    ScopeProfileNode* child(std::string const& scope);
+    void add(std::chrono::nanoseconds duration);
+
+    std::string const scope;
+    ScopeProfileNode* const parent;
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> total_ns;
+    std::atomic<uint64_t> min_ns;
+    std::atomic<uint64_t> max_ns;
+    //! \brief The number of calls whose duration in nanoseconds has base 2 logarithm i, rounded down, for bucket i
+    std::atomic<uint64_t> histogram[NUM_HISTOGRAM_BUCKETS];
+    std::atomic<ScopeProfileNode*> first_child;
+    ScopeProfileNode* next_sibling;
+};
+
+ScopeProfileNode::ScopeProfileNode(std::string const& scope_, ScopeProfileNode* parent_)
+    : scope(scope_), parent(parent_), calls(0), total_ns(0), min_ns(std::numeric_limits<uint64_t>::max()), max_ns(0),
+      first_child(nullptr), next_sibling(nullptr)
+{
+    for (auto& bucket : histogram) bucket.store(0, std::memory_order_relaxed);
+}
+
+ScopeProfileNode::~ScopeProfileNode() {
+    auto node = first_child.load();
+    while (node != nullptr) {
+        auto next = node->next_sibling;
+        delete node;
+        node = next;
+    }
+}
+
+ScopeProfileNode* ScopeProfileNode::child(std::string const& scope_) {
+    auto head = first_child.load(std::memory_order_relaxed);
+    for (auto node = head; node != nullptr; node = node->next_sibling)
+        if (node->scope == scope_) return node;
+    auto node = new ScopeProfileNode(scope_, this);
+    node->next_sibling = head;
+    first_child.store(node, std::memory_order_release);
+    return node;
+}
+
+void ScopeProfileNode::add(std::chrono::nanoseconds duration) {
+    auto ns = static_cast<uint64_t>(std::max(duration.count(), std::chrono::nanoseconds::rep(0)));
+    calls.store(calls.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+    total_ns.store(total_ns.load(std::memory_order_relaxed)+ns, std::memory_order_relaxed);
+    if (ns < min_ns.load(std::memory_order_relaxed)) min_ns.store(ns, std::memory_order_relaxed);
+    if (ns > max_ns.load(std::memory_order_relaxed)) max_ns.store(ns, std::memory_order_relaxed);
+    SizeType bucket = 0;
+    for (auto bits = ns >> 1; bits > 0 and bucket < NUM_HISTOGRAM_BUCKETS-1; bits >>= 1) ++bucket;
+    histogram[bucket].store(histogram[bucket].load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+}
+
+//! \brief A histogram of latencies with logarithmic buckets split linearly, in the style of HDR histograms
+//! \details Values are in nanoseconds and are recorded with a relative error below 1/16
+class LatencyHistogram {
+  public:
+    static const unsigned int SUB_BUCKET_BITS = 4;
+    static const SizeType NUM_BUCKETS = (64-SUB_BUCKET_BITS+1) << SUB_BUCKET_BITS;
+
+    LatencyHistogram();
+
+    void add(uint64_t ns);
+    uint64_t count() const;
+    uint64_t max() const;
+    //! \brief The smallest value not exceeded by the fraction \a q of the samples, within the bucket precision
+    uint64_t percentile(double q) const;
+  private:
+    static SizeType _bucket(uint64_t ns);
+    //! \brief The largest value falling into \a bucket
+    static uint64_t _highest_value(SizeType bucket);
+  private:
+    std::vector<uint64_t> _counts;
+    uint64_t _count;
+    uint64_t _max;
+};
+
+LatencyHistogram::LatencyHistogram() : _counts(NUM_BUCKETS,0), _count(0), _max(0) { }
+
+SizeType LatencyHistogram::_bucket(uint64_t ns) {
+    const uint64_t num_sub_buckets = uint64_t(1) << SUB_BUCKET_BITS;
+    if (ns < num_sub_buckets) return static_cast<SizeType>(ns);
+    unsigned int exponent = 0;
+    for (auto bits = ns >> 1; bits > 0; bits >>= 1) ++exponent;
+    const unsigned int shift = exponent-SUB_BUCKET_BITS;
+    return static_cast<SizeType>(((shift+1) << SUB_BUCKET_BITS) + ((ns >> shift) & (num_sub_buckets-1)));
+}
+
+uint64_t LatencyHistogram::_highest_value(SizeType bucket) {
+    const uint64_t num_sub_buckets = uint64_t(1) << SUB_BUCKET_BITS;
+    if (bucket < num_sub_buckets) return bucket;
+    const auto shift = static_cast<unsigned int>(bucket >> SUB_BUCKET_BITS)-1;
+    const uint64_t lowest = (num_sub_buckets + (bucket & (num_sub_buckets-1))) << shift;
+    return lowest + ((uint64_t(1) << shift)-1);
+}
+
+void LatencyHistogram::add(uint64_t ns) {
+    ++_counts[_bucket(ns)];
+    ++_count;
+    _max = std::max(_max,ns);
+}
+
+uint64_t LatencyHistogram::count() const {
+    return _count;
+}
+
+uint64_t LatencyHistogram::max() const {
+    return _max;
+}
+
+uint64_t LatencyHistogram::percentile(double q) const {
+    if (_count == 0) return 0;
+    auto target = std::max(uint64_t(1),static_cast<uint64_t>(std::ceil(q*static_cast<double>(_count))));
+    uint64_t cumulative = 0;
+    for (SizeType i=0; i<NUM_BUCKETS; ++i) {
+        cumulative += _counts[i];
+        if (cumulative >= target) return std::min(_highest_value(i),_max);
+    }
+    return _max;
+}
+
+thread_local SharedPointer<ScopeProfileNode> this_thread_profile_root;
+thread_local ScopeProfileNode* this_thread_profile_node = nullptr;
+
+//! \brief A trace event in binary form, as buffered by its thread
+struct TraceEvent {
+    //! \brief 'B' and 'E' for entering and exiting a scope, 'i' for a printed line, 'C' for a counter value
+    char phase;
+    //! \brief The index of the scope or counter name in the buffer
+    uint32_t name_index;
+    std::chrono::steady_clock::time_point time;
+    double value;
+    //! \brief The text of a printed line
+    std::string text;
+};
+
+//! \brief The trace events of a thread, not serialized yet
+//! \details The lock is uncontended except while writing to the trace file
+class TraceEventBuffer {
+  public:
+    TraceEventBuffer(std::string const& thread_name, unsigned int session, unsigned int track);
+
+    void add(char phase, std::string const& name, double value = 0.0);
+    void add_line(std::string text);
+    //! \brief Append the events as JSON objects, each preceded by a comma, and clear them
+    void write(std::string& out, std::chrono::steady_clock::time_point start);
+    unsigned int session() const;
+  private:
+    std::string const _thread_name;
+    unsigned int const _session;
+    unsigned int const _track;
+    bool _has_written_track_name;
+    std::vector<TraceEvent> _events;
+    std::vector<std::string> _names;
+    std::unordered_map<std::string,uint32_t> _name_indices;
+    std::mutex _mutex;
+};
+
+TraceEventBuffer::TraceEventBuffer(std::string const& thread_name, unsigned int session, unsigned int track)
+    : _thread_name(thread_name), _session(session), _track(track), _has_written_track_name(false)
+{ }
+
+unsigned int TraceEventBuffer::session() const {
+    return _session;
+}
+
+void TraceEventBuffer::add(char phase, std::string const& name, double value) {
+    auto time = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto index = _name_indices.find(name);
+    if (index == _name_indices.end()) {
+        index = _name_indices.insert({name,static_cast<uint32_t>(_names.size())}).first;
+        _names.push_back(name);
+    }
+    _events.push_back(TraceEvent({phase,index->second,time,value,std::string()}));
+}
+
+void TraceEventBuffer::add_line(std::string text) {
+    auto time = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(_mutex);
+    _events.push_back(TraceEvent({'i',0,time,0.0,std::move(text)}));
+}
+
+thread_local SharedPointer<TraceEventBuffer> this_thread_trace_buffer;
+
+thread_local SharedPointer<LogScopeChain const> this_thread_scope_chain;
+
+LogCallsite::LogCallsite(char const* file, unsigned int line, char const* function, unsigned int level, char const* format)
+    : _file(file), _line(line), _function(function), _level(level), _format(format),
+      _enabled(true), _verbosity(UNFILTERED), _id(LogCallsiteRegistry::instance()._add(this))
+{ }
+
+namespace {
+
+// Whether the text matches the glob pattern, by backtracking on the last '*' only
+bool matches_pattern(std::string_view text, std::string_view pattern) {
+    SizeType t = 0, p = 0, star = std::string_view::npos, resume = 0;
+    while (t < text.size()) {
+        if (p < pattern.size() and (pattern[p] == '?' or pattern[p] == text[t])) { ++t; ++p; }
+        else if (p < pattern.size() and pattern[p] == '*') { star = p++; resume = t; }
+        else if (star != std::string_view::npos) { p = star+1; t = ++resume; }
+        else return false;
+    }
+    while (p < pattern.size() and pattern[p] == '*') ++p;
+    return p == pattern.size();
+}
+
+std::string_view trimmed(std::string_view text) {
+    auto first = text.find_first_not_of(" \t");
+    if (first == std::string_view::npos) return {};
+    return text.substr(first,text.find_last_not_of(" \t")-first+1);
+}
+
+const std::string_view DEFAULT_FILTER_PATTERN = "default";
+
+} // namespace
+
+std::vector<LogVerbosityFilter> parse_verbosity_filters(std::string const& filters) {
+    std::vector<LogVerbosityFilter> result;
+    std::string_view remaining = filters;
+    while (not trimmed(remaining).empty()) {
+        auto comma = remaining.find(',');
+        auto item = trimmed(remaining.substr(0,comma));
+        remaining = (comma == std::string_view::npos ? std::string_view() : remaining.substr(comma+1));
+        auto colon = item.rfind(':');
+        if (colon == std::string_view::npos) throw LoggerInvalidVerbosityFiltersException();
+        auto pattern = trimmed(item.substr(0,colon));
+        auto verbosity = trimmed(item.substr(colon+1));
+        unsigned int v = 0;
+        auto parsed = std::from_chars(verbosity.data(),verbosity.data()+verbosity.size(),v);
+        if (pattern.empty() or verbosity.empty() or parsed.ec != std::errc() or parsed.ptr != verbosity.data()+verbosity.size())
+            throw LoggerInvalidVerbosityFiltersException();
+        result.push_back({std::string(pattern),v});
+    }
+    return result;
+}
+
+LogCallsiteRegistry& LogCallsiteRegistry::instance() {
+    static LogCallsiteRegistry registry;
+    return registry;
+}
+
+std::vector<LogCallsite*> LogCallsiteRegistry::callsites() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _callsites;
+}
+
+LogCallsite* LogCallsiteRegistry::callsite(LogCallsiteId id) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return (id > 0 and id <= _callsites.size() ? _callsites[id-1] : nullptr);
+}
+
+void LogCallsiteRegistry::set_verbosity_filters(std::vector<LogVerbosityFilter> const& filters) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _filters = filters;
+    for (auto callsite : _callsites) callsite->_verbosity.store(_filtered_verbosity(*callsite), std::memory_order_relaxed);
+}
+
+LogCallsiteId LogCallsiteRegistry::_add(LogCallsite* callsite) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    callsite->_verbosity.store(_filtered_verbosity(*callsite), std::memory_order_relaxed);
+    _callsites.push_back(callsite);
+    return static_cast<LogCallsiteId>(_callsites.size());
+}
+
+unsigned int LogCallsiteRegistry::_filtered_verbosity(LogCallsite const& callsite) const {
+    unsigned int result = LogCallsite::UNFILTERED;
+    for (auto const& filter : _filters) {
+        if (filter.pattern == DEFAULT_FILTER_PATTERN) {
+            if (result == LogCallsite::UNFILTERED) result = filter.verbosity;
+        } else if (matches_pattern(callsite.function(),filter.pattern) or matches_pattern(callsite.file(),filter.pattern))
+            return filter.verbosity;
+    }
+    return result;
+}
+
+LogCallsiteMark::LogCallsiteMark(LogCallsite const& callsite) : _previous(this_thread_callsite) {
+    this_thread_callsite = callsite.id();
+}
+
+LogCallsiteMark::~LogCallsiteMark() {
+    this_thread_callsite = _previous;
+}
+
 LogScopeManager::LogScopeManager(std::string scope, unsigned int level_increase)
-    : _scope(scope), _level_increase(level_increase)
+    : _scope(scope), _level_increase(level_increase), _profile_node(nullptr)
 {
+    this_thread_scope_chain = std::make_shared<LogScopeChain const>(_scope,this_thread_scope_chain);
     Logger::instance().increase_level(_level_increase);
     if ((!Logger::instance().is_muted_at(0)) and Logger::instance().configuration().prints_scope_entrance()) {
-        Logger::instance().println(0,"Enters '"+this->scope()+"'");
+        Logger::instance().println_typed(0,CONCLOG_FORMAT("Enters '{s}'"),_scope);
+    }
+    // Timing starts last and ends first, to exclude the overhead of the logger
+    if (Logger::instance().configuration().profiles_scopes()) {
+        if (this_thread_profile_root == nullptr) {
+            this_thread_profile_root = std::make_shared<ScopeProfileNode>(std::string(),nullptr);
+            this_thread_profile_node = this_thread_profile_root.get();
+            std::lock_guard<std::mutex> lock(Logger::instance()._profile_mutex);
+            Logger::instance()._profile_roots.push_back(this_thread_profile_root);
+        }
+        _profile_node = this_thread_profile_node->child(_scope);
+        this_thread_profile_node = _profile_node;
+        _profile_start = std::chrono::steady_clock::now();
+    }
+    if (Logger::instance().is_tracing()) {
+        _trace_buffer = Logger::instance()._this_thread_trace_buffer();
+        _trace_buffer->add('B',_scope);
     }
 }
 
@@ -160,15 +941,50 @@ std::string LogScopeManager::scope() const {
 }
 
 LogScopeManager::~LogScopeManager() {
+    if (_trace_buffer != nullptr) _trace_buffer->add('E',_scope);
+    if (_profile_node != nullptr) {
+        _profile_node->add(std::chrono::steady_clock::now()-_profile_start);
+        this_thread_profile_node = _profile_node->parent;
+    }
     if ((!Logger::instance().is_muted_at(0)) and Logger::instance().configuration().prints_scope_exit()) {
-        Logger::instance().println(0,"Exits '"+this->scope()+"'");
+        Logger::instance().println_typed(0,CONCLOG_FORMAT("Exits '{s}'"),_scope);
     }
     Logger::instance().decrease_level(_level_increase);
-    Logger::instance().release(this->scope());
+    Logger::instance().release(_scope);
+    if (this_thread_scope_chain != nullptr) this_thread_scope_chain = this_thread_scope_chain->parent;
+}
+
+LogContext::LogContext(unsigned int level, std::string thread_name, SharedPointer<LogScopeChain const> scope_chain)
+    : _level(level), _thread_name(thread_name), _scope_chain(scope_chain)
+{ }
+
+unsigned int LogContext::level() const {
+    return _level;
+}
+
+std::string const& LogContext::thread_name() const {
+    return _thread_name;
+}
+
+std::vector<std::string> LogContext::scopes() const {
+    std::vector<std::string> result;
+    for (auto link = _scope_chain; link != nullptr; link = link->parent) result.push_back(link->scope);
+    std::reverse(result.begin(),result.end());
+    return result;
+}
+
+LogContextGuard::LogContextGuard(LogContext const& context)
+    : _previous_context(Logger::instance().current_context())
+{
+    Logger::instance().restore_context(context);
+}
+
+LogContextGuard::~LogContextGuard() {
+    Logger::instance().restore_context(_previous_context);
 }
 
 LogThinRawMessage::LogThinRawMessage(std::string scope_, unsigned int level_, std::string text_) :
-    scope(scope_), level(level_), text(text_)
+    scope(scope_), level(level_), text(text_), timestamp(std::chrono::system_clock::now()), steady_timestamp(std::chrono::steady_clock::now()), callsite(0)
 { }
 
 RawMessageKind LogThinRawMessage::kind() const {
@@ -177,38 +993,215 @@ RawMessageKind LogThinRawMessage::kind() const {
     else return RawMessageKind::RELEASE;
 }
 
+LogTextBuffer::LogTextBuffer() {
+    clear();
+}
+
+std::string& LogTextBuffer::str() {
+    auto size = static_cast<SizeType>(pptr()-pbase());
+    _text.resize(size);
+    setp(&_text[0],&_text[0]+size);
+    pbump(static_cast<int>(size));
+    return _text;
+}
+
+void LogTextBuffer::clear() {
+    // The whole capacity is used as the put area, with no allocation
+    _text.resize(_text.capacity());
+    setp(&_text[0],&_text[0]+_text.size());
+}
+
+LogTextBuffer::int_type LogTextBuffer::overflow(int_type c) {
+    if (traits_type::eq_int_type(c,traits_type::eof())) return traits_type::not_eof(c);
+    auto size = static_cast<SizeType>(pptr()-pbase());
+    _text.resize(2*_text.size()+1);
+    _text.resize(_text.capacity());
+    setp(&_text[0],&_text[0]+_text.size());
+    pbump(static_cast<int>(size));
+    return sputc(traits_type::to_char_type(c));
+}
+
+//! \brief A formatting stream with its buffer, reset to the default formatting on each lease
+struct LogTextStream {
+    LogTextStream() : stream(&buffer) {
+        stream << std::boolalpha;
+        default_flags = stream.flags();
+    }
+    void reset() {
+        buffer.clear();
+        stream.clear();
+        stream.flags(default_flags);
+        stream.precision(6);
+        stream.width(0);
+        stream.fill(' ');
+    }
+    LogTextBuffer buffer;
+    std::ostream stream;
+    std::ios_base::fmtflags default_flags;
+};
+
+// The streams of the thread, one for each level of nesting of the leases
+thread_local std::vector<std::unique_ptr<LogTextStream>> this_thread_text_streams;
+thread_local SizeType this_thread_text_stream_depth = 0;
+
+LogTextStreamLease::LogTextStreamLease() {
+    if (this_thread_text_stream_depth == this_thread_text_streams.size())
+        this_thread_text_streams.push_back(std::make_unique<LogTextStream>());
+    _stream = this_thread_text_streams[this_thread_text_stream_depth++].get();
+    _stream->reset();
+}
+
+LogTextStreamLease::~LogTextStreamLease() {
+    --this_thread_text_stream_depth;
+}
+
+std::ostream& LogTextStreamLease::stream() {
+    return _stream->stream;
+}
+
+std::string&& LogTextStreamLease::take() {
+    return std::move(_stream->buffer.str());
+}
+
+void invalid_placeholder_in_log_format() {
+    throw std::invalid_argument("Invalid placeholder in log format");
+}
+
+char const* write_until_placeholder(std::ostream& os, char const* format) {
+    char const* placeholder = std::strstr(format, "{}");
+    if (placeholder == nullptr) {
+        os << format;
+        return nullptr;
+    }
+    os.write(format, placeholder-format);
+    return placeholder+2;
+}
+
 LoggerData::LoggerData(unsigned int current_level, std::string const& thread_name)
-    : _current_level(current_level), _thread_name(thread_name), _is_dead(false)
+    : _current_level(current_level), _verbosity_override(NO_VERBOSITY_OVERRIDE), _thread_name(thread_name), _logical_name(thread_name), _dequeued_thread_name(thread_name), _queue_size(0), _is_dead(false),
+      _num_submitted(0), _num_submitted_bytes(0), _queue_high_water(0), _blocked_ns(0)
 { }
 
+std::unique_lock<std::mutex> LoggerData::_lock_queue() {
+    return lock_accounting_contention(_queue_mutex, _blocked_ns);
+}
+
+void LoggerData::_update_queue_size() {
+    auto size = _raw_messages.size();
+    _queue_size.store(size, std::memory_order_relaxed);
+    if (size > _queue_high_water.load(std::memory_order_relaxed)) _queue_high_water.store(size, std::memory_order_relaxed);
+}
+
+void LoggerData::count_submission(SizeType bytes) {
+    add_to_counter(_num_submitted, SizeType(1));
+    add_to_counter(_num_submitted_bytes, bytes);
+}
+
+void LoggerData::add_statistics(LoggerStatistics& statistics) const {
+    statistics.messages_enqueued += _num_submitted.load(std::memory_order_relaxed);
+    statistics.bytes_enqueued += _num_submitted_bytes.load(std::memory_order_relaxed);
+    statistics.queue_high_water = std::max(statistics.queue_high_water, _queue_high_water.load(std::memory_order_relaxed));
+    statistics.producer_blocked_time += std::chrono::nanoseconds(_blocked_ns.load(std::memory_order_relaxed));
+    _payload_arena.add_statistics(statistics);
+}
+
 unsigned int LoggerData::current_level() const {
     return _current_level;
 }
 
-std::string LoggerData::thread_name() const {
+std::string const& LoggerData::thread_name() const {
     return _thread_name;
 }
 
-void LoggerData::enqueue_println(unsigned int level_increase, std::string text) {
-    const std::lock_guard<std::mutex> lock(_queue_mutex);
-    _raw_messages.push(LogThinRawMessage(std::string(), _current_level + level_increase, text));
+std::string const& LoggerData::logical_name() const {
+    return _logical_name;
 }
 
-void LoggerData::enqueue_hold(std::string scope, std::string text) {
-    const std::lock_guard<std::mutex> lock(_queue_mutex);
-    _raw_messages.push(LogThinRawMessage(scope, _current_level, text));
+std::string const& LoggerData::dequeued_thread_name() const {
+    return _dequeued_thread_name;
 }
 
-void LoggerData::enqueue_release(std::string scope) {
+LogQueueEntry& LoggerData::_push_message(std::string_view scope, unsigned int level, std::string_view text) {
+    auto& entry = _raw_messages.push_back();
+    entry.scope.assign(scope);
+    entry.level = level;
+    entry.callsite = this_thread_callsite;
+    entry.text.assign(text, _payload_arena, Logger::instance().configuration().payload_chunk_size());
+    entry.timestamp = std::chrono::system_clock::now();
+    entry.steady_timestamp = std::chrono::steady_clock::now();
+    entry.deferred_format = LogDeferredFormat{nullptr,nullptr};
+    entry.barrier.reset();
+    entry.new_thread_name.clear();
+    _update_queue_size();
+    return entry;
+}
+
+void LoggerData::enqueue_println(unsigned int level_increase, std::string_view text) {
+    const auto lock = _lock_queue();
+    count_submission(text.size());
+    _push_message(std::string_view(), _current_level + level_increase, text);
+}
+
+void LoggerData::enqueue_println_static(unsigned int level_increase, std::string_view text) {
+    const auto lock = _lock_queue();
+    count_submission(text.size());
+    _push_message(std::string_view(), _current_level + level_increase, std::string_view()).deferred_format = LogDeferredFormat{text.data(), &write_deferred_format<>};
+}
+
+void LoggerData::enqueue_println_deferred(unsigned int level_increase, LogDeferredFormat const& format, std::string_view arguments) {
+    const auto lock = _lock_queue();
+    count_submission(arguments.size());
+    _push_message(std::string_view(), _current_level + level_increase, arguments).deferred_format = format;
+}
+
+void LoggerData::enqueue_hold(std::string_view scope, std::string_view text) {
+    const auto lock = _lock_queue();
+    count_submission(text.size());
+    _push_message(scope, _current_level, text);
+}
+
+void LoggerData::enqueue_release(std::string_view scope) {
+    const auto lock = _lock_queue();
+    count_submission(0);
+    _push_message(scope, _current_level, std::string_view());
+}
+
+void LoggerData::enqueue_barrier(SharedPointer<FlushBarrier> barrier) {
     const std::lock_guard<std::mutex> lock(_queue_mutex);
-    _raw_messages.push(LogThinRawMessage(scope, _current_level, std::string()));
+    auto& entry = _raw_messages.push_back();
+    entry.barrier = std::move(barrier);
+    entry.new_thread_name.clear();
+    _update_queue_size();
 }
 
-LogThinRawMessage LoggerData::dequeue() {
+void LoggerData::enqueue_logical_name(std::string logical_name) {
+    const auto lock = _lock_queue();
+    _logical_name = logical_name;
+    auto& entry = _raw_messages.push_back();
+    entry.barrier.reset();
+    entry.new_thread_name.assign(logical_name);
+    _update_queue_size();
+}
+
+bool LoggerData::dequeue(LogThinRawMessage& msg, LogDeferredFormat& deferred_format, SharedPointer<FlushBarrier>& barrier) {
     const std::lock_guard<std::mutex> lock(_queue_mutex);
-    LogThinRawMessage result = _raw_messages.front();
-    _raw_messages.pop();
-    return result;
+    auto& front = _raw_messages.front();
+    // The message of other entries is stale, hence it must not take the place of a string already in use
+    bool const is_message = front.is_message();
+    if (is_message) {
+        msg.scope.swap(front.scope);
+        msg.level = front.level;
+        front.text.move_to(msg.text, _payload_arena);
+        msg.timestamp = front.timestamp;
+        msg.steady_timestamp = front.steady_timestamp;
+        msg.callsite = front.callsite;
+        deferred_format = front.deferred_format;
+    }
+    std::swap(barrier,front.barrier);
+    if (not front.new_thread_name.empty()) _dequeued_thread_name.assign(front.new_thread_name);
+    _raw_messages.pop_front();
+    _queue_size.store(_raw_messages.size(), std::memory_order_relaxed);
+    return is_message;
 }
 
 void LoggerData::kill() {
@@ -216,7 +1209,16 @@ void LoggerData::kill() {
 }
 
 bool LoggerData::is_dead() const {
-    return _is_dead;
+    return _is_dead.load(std::memory_order_relaxed);
+}
+
+void LoggerData::revive(unsigned int current_level, std::string const& thread_name) {
+    _current_level = current_level;
+    _verbosity_override = NO_VERBOSITY_OVERRIDE;
+    _thread_name = thread_name;
+    _logical_name = thread_name;
+    _dequeued_thread_name = thread_name;
+    _is_dead = false;
 }
 
 void LoggerData::increase_level(unsigned int i) {
@@ -227,42 +1229,109 @@ void LoggerData::decrease_level(unsigned int i) {
     _current_level -= i;
 }
 
+unsigned int LoggerData::verbosity_override() const {
+    return _verbosity_override.load(std::memory_order_relaxed);
+}
+
+void LoggerData::set_verbosity_override(unsigned int v) {
+    _verbosity_override.store(v, std::memory_order_relaxed);
+}
+
 SizeType LoggerData::queue_size() const {
-    return _raw_messages.size();
+    return _queue_size.load(std::memory_order_relaxed);
 }
 
+void LoggerData::emergency_write(int fd) const {
+    _raw_messages.for_each([this,fd](LogQueueEntry const& entry) {
+        // The arguments of a deferred format cannot be written without allocating, hence only the format is
+        if (entry.is_message() and entry.is_deferred())
+            emergency_write_message(fd,_thread_name,entry.level,entry.deferred_format.format,std::strlen(entry.deferred_format.format));
+        else if (entry.is_message() and not entry.is_release())
+            emergency_write_message(fd,_thread_name,entry.level,entry.text);
+    });
+}
+
+//! \brief The level, name and verbosity override of a thread, transferred when changing scheduler
+struct LoggerThreadState {
+    unsigned int level;
+    std::string name;
+    unsigned int verbosity_override;
+};
+
+//! \brief The state of each thread known to a scheduler
+using LoggerThreadStates = std::map<std::thread::id,LoggerThreadState>;
+
 class LoggerSchedulerInterface {
   public:
-    virtual void println(unsigned int level_increase, std::string text) = 0;
-    virtual void hold(std::string scope, std::string text) = 0;
-    virtual void release(std::string scope) = 0;
-    virtual unsigned int current_level() const = 0;
-    virtual std::string current_thread_name() const = 0;
+    virtual void println(LoggerData& data, unsigned int level_increase, std::string&& text) = 0;
+    virtual void println(LoggerData& data, unsigned int level_increase, std::string_view text) = 0;
+    //! \brief Print the null-terminated \a text, which outlives the logger and hence can be kept by pointer
+    virtual void println_static(LoggerData& data, unsigned int level_increase, std::string_view text) = 0;
+    //! \brief Print the \a format with the \a arguments copied as bytes, writing the text when the scheduler prints
+    virtual void println_deferred(LoggerData& data, unsigned int level_increase, LogDeferredFormat const& format, std::string&& arguments) = 0;
+    virtual void hold(LoggerData& data, std::string_view scope, std::string&& text) = 0;
+    virtual void hold(LoggerData& data, std::string_view scope, std::string_view text) = 0;
+    virtual void release(LoggerData& data, std::string_view scope) = 0;
+    //! \brief Change the name the messages of \a data are attributed to from now on, keeping the name it is registered with
+    virtual void set_logical_name(LoggerData& data, std::string name) = 0;
     virtual SizeType largest_thread_name_size() const = 0;
-    virtual void increase_level(unsigned int i) = 0;
-    virtual void decrease_level(unsigned int i) = 0;
+    //! \brief Get the data of the thread with the given \a id, or nullptr if the thread is not known
+    virtual SharedPointer<LoggerData> data_instance(std::thread::id id) const = 0;
+    //! \brief Create the data of a thread, unless it already exists and is alive
+    virtual void create_data_instance(std::thread::id id, std::string name, unsigned int level) = 0;
+    virtual void kill_data_instance(std::thread::id id) = 0;
     virtual void terminate() = 0;
+    //! \brief Stop the scheduler as soon as the messages enqueued so far are written, regardless of registered threads
+    //! \details Submission must be prevented by the caller
+    virtual void stop() = 0;
+    //! \brief Get the states of the threads still alive
+    virtual LoggerThreadStates thread_states() const = 0;
+    //! \brief Set the states of threads, replacing the existing ones
+    virtual void import_thread_states(LoggerThreadStates const& states) = 0;
+    //! \brief Get a future that is ready when all the messages submitted so far have been written
+    virtual std::future<void> flush() = 0;
+    //! \brief Write the messages not printed yet to the file descriptor \a fd, from a signal handler
+    virtual void emergency_flush(int fd) const = 0;
+    //! \brief Add the counters of the scheduler to \a statistics
+    virtual void collect_statistics(LoggerStatistics& statistics) const = 0;
+    //! \brief The kind of scheduler, for reports
+    virtual char const* kind() const = 0;
     virtual ~LoggerSchedulerInterface() = default;
 };
 
 //! \brief A Logger scheduler that prints immediately. Not designed for concurrency, since
-//! the current level should be different for each thread that prints. Also the outputs can overlap arbitrarily.
+//! the outputs can overlap arbitrarily.
+//! \details Each thread has its own data, to keep levels and names across changes of scheduler,
+//! but messages are printed with an empty name, which stands for the id of the printing thread
 class ImmediateLoggerScheduler : public LoggerSchedulerInterface {
   public:
     ImmediateLoggerScheduler();
-    void println(unsigned int level_increase, std::string text) override;
-    void hold(std::string scope, std::string text) override;
-    void release(std::string scope) override;
-    unsigned int current_level() const override;
-    std::string current_thread_name() const override;
+    void println(LoggerData& data, unsigned int level_increase, std::string&& text) override;
+    void println(LoggerData& data, unsigned int level_increase, std::string_view text) override;
+    void println_static(LoggerData& data, unsigned int level_increase, std::string_view text) override;
+    void println_deferred(LoggerData& data, unsigned int level_increase, LogDeferredFormat const& format, std::string&& arguments) override;
+    void hold(LoggerData& data, std::string_view scope, std::string&& text) override;
+    void hold(LoggerData& data, std::string_view scope, std::string_view text) override;
+    void release(LoggerData& data, std::string_view scope) override;
+    void set_logical_name(LoggerData& data, std::string name) override;
     SizeType largest_thread_name_size() const override;
-    void increase_level(unsigned int i) override;
-    void decrease_level(unsigned int i) override;
+    SharedPointer<LoggerData> data_instance(std::thread::id id) const override;
+    void create_data_instance(std::thread::id id, std::string name, unsigned int level) override;
+    void kill_data_instance(std::thread::id id) override;
     void terminate() override;
+    void stop() override;
+    LoggerThreadStates thread_states() const override;
+    void import_thread_states(LoggerThreadStates const& states) override;
+    std::future<void> flush() override;
+    void emergency_flush(int fd) const override;
+    void collect_statistics(LoggerStatistics& statistics) const override;
+    char const* kind() const override;
   private:
-    void _dequeue_pending();
-  private:
-    unsigned int _current_level;
+    std::map<std::thread::id,SharedPointer<LoggerData>> _data;
+    // Guards the data only, since printing is not synchronised
+    mutable std::mutex _data_mutex;
+    // The counters of the data removed
+    LoggerStatistics _retired_statistics;
 };
 
 //! \brief A Logger scheduler that enqueues messages and prints them sequentially.
@@ -270,21 +1339,33 @@ class ImmediateLoggerScheduler : public LoggerSchedulerInterface {
 class BlockingLoggerScheduler : public LoggerSchedulerInterface {
   public:
     BlockingLoggerScheduler();
-    void println(unsigned int level_increase, std::string text) override;
-    void hold(std::string scope, std::string text) override;
-    void release(std::string scope) override;
-    unsigned int current_level() const override;
-    std::string current_thread_name() const override;
+    void println(LoggerData& data, unsigned int level_increase, std::string&& text) override;
+    void println(LoggerData& data, unsigned int level_increase, std::string_view text) override;
+    void println_static(LoggerData& data, unsigned int level_increase, std::string_view text) override;
+    void println_deferred(LoggerData& data, unsigned int level_increase, LogDeferredFormat const& format, std::string&& arguments) override;
+    void hold(LoggerData& data, std::string_view scope, std::string&& text) override;
+    void hold(LoggerData& data, std::string_view scope, std::string_view text) override;
+    void release(LoggerData& data, std::string_view scope) override;
+    void set_logical_name(LoggerData& data, std::string name) override;
     SizeType largest_thread_name_size() const override;
-    void increase_level(unsigned int i) override;
-    void decrease_level(unsigned int i) override;
-    void create_data_instance(std::thread::id id, std::string name);
-    void create_data_instance(std::thread::id id, std::string name, unsigned int level);
-    void kill_data_instance(std::thread::id id);
+    SharedPointer<LoggerData> data_instance(std::thread::id id) const override;
+    void create_data_instance(std::thread::id id, std::string name, unsigned int level) override;
+    void kill_data_instance(std::thread::id id) override;
     void terminate() override;
+    void stop() override;
+    LoggerThreadStates thread_states() const override;
+    void import_thread_states(LoggerThreadStates const& states) override;
+    std::future<void> flush() override;
+    void emergency_flush(int fd) const override;
+    void collect_statistics(LoggerStatistics& statistics) const override;
+    char const* kind() const override;
   private:
-    std::map<std::thread::id,std::pair<unsigned int,std::string>> _data;
-    std::mutex _data_mutex;
+    std::map<std::thread::id,SharedPointer<LoggerData>> _data;
+    mutable std::mutex _data_mutex;
+    // The counters of the data removed
+    LoggerStatistics _retired_statistics;
+    // Reused for each message printed, under the data mutex
+    LogRawMessage _message;
 };
 
 //! \brief A Logger scheduler that enqueues messages and prints them in a dedicated thread.
@@ -292,25 +1373,34 @@ class BlockingLoggerScheduler : public LoggerSchedulerInterface {
 class NonblockingLoggerScheduler : public LoggerSchedulerInterface {
   public:
     NonblockingLoggerScheduler();
-    void println(unsigned int level_increase, std::string text) override;
-    void hold(std::string scope, std::string text) override;
-    void release(std::string scope) override;
-    unsigned int current_level() const override;
-    std::string current_thread_name() const override;
+    void println(LoggerData& data, unsigned int level_increase, std::string&& text) override;
+    void println(LoggerData& data, unsigned int level_increase, std::string_view text) override;
+    void println_static(LoggerData& data, unsigned int level_increase, std::string_view text) override;
+    void println_deferred(LoggerData& data, unsigned int level_increase, LogDeferredFormat const& format, std::string&& arguments) override;
+    void hold(LoggerData& data, std::string_view scope, std::string&& text) override;
+    void hold(LoggerData& data, std::string_view scope, std::string_view text) override;
+    void release(LoggerData& data, std::string_view scope) override;
+    void set_logical_name(LoggerData& data, std::string name) override;
     SizeType largest_thread_name_size() const override;
-    void increase_level(unsigned int i) override;
-    void decrease_level(unsigned int i) override;
-    void create_data_instance(std::thread::id id, std::string name);
-    void create_data_instance(std::thread::id id, std::string name, unsigned int level);
-    void kill_data_instance(std::thread::id id);
+    SharedPointer<LoggerData> data_instance(std::thread::id id) const override;
+    void create_data_instance(std::thread::id id, std::string name, unsigned int level) override;
+    void kill_data_instance(std::thread::id id) override;
     void terminate() override;
+    void stop() override;
+    LoggerThreadStates thread_states() const override;
+    void import_thread_states(LoggerThreadStates const& states) override;
+    std::future<void> flush() override;
+    void emergency_flush(int fd) const override;
+    void collect_statistics(LoggerStatistics& statistics) const override;
+    char const* kind() const override;
     ~NonblockingLoggerScheduler() override;
   private:
-    //! \brief Extracts one message from the largest queue
-    LogRawMessage _dequeue();
+    //! \brief Dequeue from the largest queue, as for LoggerData::dequeue, also setting the \a thread_name of the entry
+    bool _dequeue(std::string& thread_name, LogThinRawMessage& msg, LogDeferredFormat& deferred_format, SharedPointer<FlushBarrier>& barrier);
     void _consume_msgs();
     bool _is_queue_empty() const;
     bool _are_alive_threads_registered() const;
+    void _update_largest_thread_name_size(std::string const& name);
  private:
     std::mutex _message_availability_mutex;
     std::condition_variable _message_availability_condition;
@@ -321,135 +1411,419 @@ class NonblockingLoggerScheduler : public LoggerSchedulerInterface {
     std::promise<void> _termination_promise;
     std::future<void> _termination_future;
     SharedPointer<MessageConsumptionThread> _dequeueing_thread;
+    // Set by the consumption thread when started, to recognise flushes requested while writing a message
+    std::atomic<std::thread::id> _consumer_thread_id;
     std::map<std::thread::id,SharedPointer<LoggerData>> _data;
+    // Read by the consumption thread while other threads register, hence not computed from the data
+    std::atomic<SizeType> _largest_thread_name_size;
+    // The counters of the data removed
+    LoggerStatistics _retired_statistics;
+    // Written by the consumption thread only; times are in nanoseconds of the steady clock
+    std::chrono::steady_clock::time_point const _consumer_start;
+    std::atomic<int64_t> _consumer_end_ns;
+    std::atomic<int64_t> _consumer_idle_since_ns;
+    std::atomic<uint64_t> _consumer_idle_ns;
+    std::atomic<SizeType> _num_written;
+    std::atomic<SizeType> _num_written_bytes;
 };
 
-ImmediateLoggerScheduler::ImmediateLoggerScheduler() : _current_level(1) { }
+int64_t steady_clock_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
-unsigned int ImmediateLoggerScheduler::current_level() const {
-    return _current_level;
+//! \brief Add the \a addend statistics to the \a total ones
+void accumulate_statistics(LoggerStatistics& total, LoggerStatistics const& addend) {
+    total.messages_enqueued += addend.messages_enqueued;
+    total.bytes_enqueued += addend.bytes_enqueued;
+    total.messages_written += addend.messages_written;
+    total.bytes_written += addend.bytes_written;
+    total.queue_depth += addend.queue_depth;
+    total.queue_high_water = std::max(total.queue_high_water, addend.queue_high_water);
+    total.producer_blocked_time += addend.producer_blocked_time;
+    total.consumer_busy_time += addend.consumer_busy_time;
+    total.consumer_idle_time += addend.consumer_idle_time;
+    total.payload_chunks_allocated += addend.payload_chunks_allocated;
+    total.payload_bytes_allocated += addend.payload_bytes_allocated;
+    total.payload_chunks_reused += addend.payload_chunks_reused;
 }
 
-std::string ImmediateLoggerScheduler::current_thread_name() const {
-    std::stringstream ss;
-    ss << std::this_thread::get_id();
-    return ss.str();
+ImmediateLoggerScheduler::ImmediateLoggerScheduler() {
+    _data.insert({std::this_thread::get_id(),SharedPointer<LoggerData>(new LoggerData(1,Logger::_MAIN_THREAD_NAME))});
 }
 
 SizeType ImmediateLoggerScheduler::largest_thread_name_size() const {
-    return current_thread_name().size();
+    return Logger::instance().current_thread_name().size();
+}
+
+SharedPointer<LoggerData> ImmediateLoggerScheduler::data_instance(std::thread::id id) const {
+    std::lock_guard<std::mutex> lock(_data_mutex);
+    auto entry = _data.find(id);
+    return (entry != _data.end() ? entry->second : nullptr);
+}
+
+void ImmediateLoggerScheduler::create_data_instance(std::thread::id id, std::string name, unsigned int level) {
+    std::lock_guard<std::mutex> lock(_data_mutex);
+    // Won't replace if it already exists
+    _data.insert({id,SharedPointer<LoggerData>(new LoggerData(level,name))});
+}
+
+void ImmediateLoggerScheduler::kill_data_instance(std::thread::id id) {
+    std::lock_guard<std::mutex> lock(_data_mutex);
+    auto entry = _data.find(id);
+    if (entry != _data.end()) {
+        entry->second->kill();
+        entry->second->add_statistics(_retired_statistics);
+        _data.erase(entry);
+    }
 }
 
-void ImmediateLoggerScheduler::increase_level(unsigned int i) {
-    _current_level+=i;
+// Reused for each message printed by the thread, since threads are not synchronised by the immediate scheduler
+thread_local LogRawMessage this_thread_immediate_message(std::string(),0,std::string());
+
+void ImmediateLoggerScheduler::println(LoggerData& data, unsigned int level_increase, std::string&& text) {
+    data.count_submission(text.size());
+    assign_message(this_thread_immediate_message, std::string(), std::string_view(), data.current_level() + level_increase, std::move(text));
+    Logger::instance()._println(this_thread_immediate_message);
+}
+
+void ImmediateLoggerScheduler::println(LoggerData& data, unsigned int level_increase, std::string_view text) {
+    data.count_submission(text.size());
+    assign_message(this_thread_immediate_message, std::string(), std::string_view(), data.current_level() + level_increase, text);
+    Logger::instance()._println(this_thread_immediate_message);
 }
 
-void ImmediateLoggerScheduler::decrease_level(unsigned int i) {
-    _current_level-=i;
+void ImmediateLoggerScheduler::println_static(LoggerData& data, unsigned int level_increase, std::string_view text) {
+    println(data, level_increase, text);
 }
 
-void ImmediateLoggerScheduler::println(unsigned int level_increase, std::string text) {
-    Logger::instance()._println(LogRawMessage(std::string(), _current_level + level_increase, text));
+void ImmediateLoggerScheduler::println_deferred(LoggerData& data, unsigned int level_increase, LogDeferredFormat const& format, std::string&& arguments) {
+    write_deferred_text(arguments, format, arguments);
+    println(data, level_increase, std::move(arguments));
 }
 
-void ImmediateLoggerScheduler::hold(std::string scope, std::string text) {
-    Logger::instance()._hold(LogRawMessage(scope, _current_level, text));
+void ImmediateLoggerScheduler::hold(LoggerData& data, std::string_view scope, std::string&& text) {
+    data.count_submission(text.size());
+    assign_message(this_thread_immediate_message, std::string(), scope, data.current_level(), std::move(text));
+    Logger::instance()._hold(this_thread_immediate_message);
 }
 
-void ImmediateLoggerScheduler::release(std::string scope) {
-    Logger::instance()._release(LogRawMessage(scope, _current_level, std::string()));
+void ImmediateLoggerScheduler::hold(LoggerData& data, std::string_view scope, std::string_view text) {
+    data.count_submission(text.size());
+    assign_message(this_thread_immediate_message, std::string(), scope, data.current_level(), text);
+    Logger::instance()._hold(this_thread_immediate_message);
+}
+
+void ImmediateLoggerScheduler::release(LoggerData& data, std::string_view scope) {
+    data.count_submission(0);
+    assign_message(this_thread_immediate_message, std::string(), scope, data.current_level(), std::string_view());
+    Logger::instance()._release(this_thread_immediate_message);
+}
+
+void ImmediateLoggerScheduler::set_logical_name(LoggerData& data, std::string name) {
+    std::lock_guard<std::mutex> lock(_data_mutex);
+    data._logical_name = name;
+    data._dequeued_thread_name = name;
 }
 
 void ImmediateLoggerScheduler::terminate() { }
 
-BlockingLoggerScheduler::BlockingLoggerScheduler() {
-    _data.insert({std::this_thread::get_id(),std::make_pair(1,Logger::_MAIN_THREAD_NAME)});
+void ImmediateLoggerScheduler::stop() { }
+
+LoggerThreadStates ImmediateLoggerScheduler::thread_states() const {
+    std::lock_guard<std::mutex> lock(_data_mutex);
+    LoggerThreadStates result;
+    for (auto const& entry : _data)
+        result.insert({entry.first,{entry.second->current_level(),entry.second->thread_name(),entry.second->verbosity_override()}});
+    return result;
 }
 
-void BlockingLoggerScheduler::create_data_instance(std::thread::id id, std::string name) {
-    create_data_instance(id,name,current_level());
+void ImmediateLoggerScheduler::import_thread_states(LoggerThreadStates const& states) {
+    std::lock_guard<std::mutex> lock(_data_mutex);
+    for (auto const& entry : states) {
+        auto data = SharedPointer<LoggerData>(new LoggerData(entry.second.level,entry.second.name));
+        data->set_verbosity_override(entry.second.verbosity_override);
+        _data[entry.first] = data;
+    }
+}
+
+//! \brief Flush the log output, returning a future that is ready already
+std::future<void> flushed_future() {
+    std::promise<void> written;
+    std::clog << std::flush;
+    written.set_value();
+    return written.get_future();
+}
+
+std::future<void> ImmediateLoggerScheduler::flush() {
+    return flushed_future();
+}
+
+void ImmediateLoggerScheduler::emergency_flush(int) const { }
+
+char const* ImmediateLoggerScheduler::kind() const {
+    return "immediate";
+}
+
+void ImmediateLoggerScheduler::collect_statistics(LoggerStatistics& statistics) const {
+    // Messages are written as soon as submitted
+    std::lock_guard<std::mutex> lock(_data_mutex);
+    LoggerStatistics result = _retired_statistics;
+    for (auto const& entry : _data) entry.second->add_statistics(result);
+    result.messages_written = result.messages_enqueued;
+    result.bytes_written = result.bytes_enqueued;
+    accumulate_statistics(statistics,result);
+}
+
+BlockingLoggerScheduler::BlockingLoggerScheduler() : _message(std::string(),0,std::string()) {
+    _data.insert({std::this_thread::get_id(),SharedPointer<LoggerData>(new LoggerData(1,Logger::_MAIN_THREAD_NAME))});
+}
+
+SharedPointer<LoggerData> BlockingLoggerScheduler::data_instance(std::thread::id id) const {
+    std::lock_guard<std::mutex> lock(_data_mutex);
+    auto entry = _data.find(id);
+    return (entry != _data.end() ? entry->second : nullptr);
 }
 
 void BlockingLoggerScheduler::create_data_instance(std::thread::id id, std::string name, unsigned int level) {
     std::lock_guard<std::mutex> lock(_data_mutex);
     // Won't replace if it already exists
-    _data.insert({id,make_pair(level,name)});
+    _data.insert({id,SharedPointer<LoggerData>(new LoggerData(level,name))});
 }
 
 void BlockingLoggerScheduler::kill_data_instance(std::thread::id id) {
     std::unique_lock<std::mutex> lock(_data_mutex);
     auto entry = _data.find(id);
-    if (entry != _data.end()) _data.erase(entry);
+    if (entry != _data.end()) {
+        entry->second->kill();
+        entry->second->add_statistics(_retired_statistics);
+        _data.erase(entry);
+    }
 }
 
-unsigned int BlockingLoggerScheduler::current_level() const {
-    return _data.find(std::this_thread::get_id())->second.first;
+SizeType BlockingLoggerScheduler::largest_thread_name_size() const {
+    SizeType result = 0;
+    for (auto const& entry : _data) result = std::max(result,entry.second->logical_name().size());
+    return result;
 }
 
-std::string BlockingLoggerScheduler::current_thread_name() const {
-    return _data.find(std::this_thread::get_id())->second.second;
+void BlockingLoggerScheduler::println(LoggerData& data, unsigned int level_increase, std::string&& text) {
+    const auto lock = lock_accounting_contention(_data_mutex,data._blocked_ns);
+    data.count_submission(text.size());
+    assign_message(_message, data.logical_name(), std::string_view(), data.current_level() + level_increase, std::move(text));
+    Logger::instance()._println(_message);
 }
 
-SizeType BlockingLoggerScheduler::largest_thread_name_size() const {
-    SizeType result = 0;
-    for (auto entry : _data) result = std::max(result,entry.second.second.size());
+void BlockingLoggerScheduler::println(LoggerData& data, unsigned int level_increase, std::string_view text) {
+    const auto lock = lock_accounting_contention(_data_mutex,data._blocked_ns);
+    data.count_submission(text.size());
+    assign_message(_message, data.logical_name(), std::string_view(), data.current_level() + level_increase, text);
+    Logger::instance()._println(_message);
+}
+
+void BlockingLoggerScheduler::println_static(LoggerData& data, unsigned int level_increase, std::string_view text) {
+    println(data, level_increase, text);
+}
+
+void BlockingLoggerScheduler::println_deferred(LoggerData& data, unsigned int level_increase, LogDeferredFormat const& format, std::string&& arguments) {
+    // Written before locking, since there is no consumption thread to defer to
+    write_deferred_text(arguments, format, arguments);
+    println(data, level_increase, std::move(arguments));
+}
+
+void BlockingLoggerScheduler::hold(LoggerData& data, std::string_view scope, std::string&& text) {
+    const auto lock = lock_accounting_contention(_data_mutex,data._blocked_ns);
+    data.count_submission(text.size());
+    assign_message(_message, data.logical_name(), scope, data.current_level(), std::move(text));
+    Logger::instance()._hold(_message);
+}
+
+void BlockingLoggerScheduler::hold(LoggerData& data, std::string_view scope, std::string_view text) {
+    const auto lock = lock_accounting_contention(_data_mutex,data._blocked_ns);
+    data.count_submission(text.size());
+    assign_message(_message, data.logical_name(), scope, data.current_level(), text);
+    Logger::instance()._hold(_message);
+}
+
+void BlockingLoggerScheduler::release(LoggerData& data, std::string_view scope) {
+    const auto lock = lock_accounting_contention(_data_mutex,data._blocked_ns);
+    data.count_submission(0);
+    assign_message(_message, data.logical_name(), scope, data.current_level(), std::string_view());
+    Logger::instance()._release(_message);
+}
+
+void BlockingLoggerScheduler::set_logical_name(LoggerData& data, std::string name) {
+    std::lock_guard<std::mutex> lock(_data_mutex);
+    data._logical_name = name;
+    data._dequeued_thread_name = name;
+}
+
+void BlockingLoggerScheduler::terminate() { }
+
+void BlockingLoggerScheduler::stop() { }
+
+LoggerThreadStates BlockingLoggerScheduler::thread_states() const {
+    std::lock_guard<std::mutex> lock(_data_mutex);
+    LoggerThreadStates result;
+    for (auto const& entry : _data)
+        result.insert({entry.first,{entry.second->current_level(),entry.second->thread_name(),entry.second->verbosity_override()}});
     return result;
 }
 
-void BlockingLoggerScheduler::increase_level(unsigned int i) {
+void BlockingLoggerScheduler::import_thread_states(LoggerThreadStates const& states) {
     std::lock_guard<std::mutex> lock(_data_mutex);
-    _data.find(std::this_thread::get_id())->second.first += i;
+    for (auto const& entry : states) {
+        auto data = SharedPointer<LoggerData>(new LoggerData(entry.second.level,entry.second.name));
+        data->set_verbosity_override(entry.second.verbosity_override);
+        _data[entry.first] = data;
+    }
+}
+
+std::future<void> BlockingLoggerScheduler::flush() {
+    std::promise<void> written;
+    {
+        std::lock_guard<std::mutex> lock(_data_mutex);
+        std::clog << std::flush;
+    }
+    written.set_value();
+    return written.get_future();
+}
+
+void BlockingLoggerScheduler::emergency_flush(int) const { }
+
+char const* BlockingLoggerScheduler::kind() const {
+    return "blocking";
+}
+
+void BlockingLoggerScheduler::collect_statistics(LoggerStatistics& statistics) const {
+    // Messages are written as soon as submitted
+    std::lock_guard<std::mutex> lock(_data_mutex);
+    LoggerStatistics result = _retired_statistics;
+    for (auto const& entry : _data) entry.second->add_statistics(result);
+    result.messages_written = result.messages_enqueued;
+    result.bytes_written = result.bytes_enqueued;
+    accumulate_statistics(statistics,result);
+}
+
+NonblockingLoggerScheduler::NonblockingLoggerScheduler() : _terminate(false), _no_alive_thread_registered(true), _termination_future(_termination_promise.get_future()),
+                                                           _consumer_thread_id(std::thread::id()), _largest_thread_name_size(Logger::_MAIN_THREAD_NAME.size()), _consumer_start(std::chrono::steady_clock::now()),
+                                                           _consumer_end_ns(0), _consumer_idle_since_ns(0), _consumer_idle_ns(0), _num_written(0), _num_written_bytes(0) {
+    {
+        std::lock_guard<std::mutex> lock(_data_mutex);
+        _data.insert({std::this_thread::get_id(),SharedPointer<LoggerData>(new LoggerData(1,Logger::_MAIN_THREAD_NAME))});
+    }
+    _dequeueing_thread = std::make_shared<MessageConsumptionThread>([this] { _consume_msgs(); });
+}
+
+void NonblockingLoggerScheduler::terminate() {
+    {
+        std::unique_lock<std::mutex> lock(_message_availability_mutex);
+        _terminate = true;
+        _message_availability_condition.notify_one();
+    }
+    _termination_future.get();
+    _dequeueing_thread.reset();
 }
 
-void BlockingLoggerScheduler::decrease_level(unsigned int i) {
-    std::lock_guard<std::mutex> lock(_data_mutex);
-    _data.find(std::this_thread::get_id())->second.first -= i;
+void NonblockingLoggerScheduler::stop() {
+    {
+        std::unique_lock<std::mutex> lock(_message_availability_mutex);
+        _terminate = true;
+        _no_alive_thread_registered = true;
+        _message_availability_condition.notify_one();
+    }
+    _termination_future.get();
+    _dequeueing_thread.reset();
 }
 
-void BlockingLoggerScheduler::println(unsigned int level_increase, std::string text) {
+LoggerThreadStates NonblockingLoggerScheduler::thread_states() const {
     std::lock_guard<std::mutex> lock(_data_mutex);
-    Logger::instance()._println(LogRawMessage(_data.find(std::this_thread::get_id())->second.second, std::string(), _data.find(std::this_thread::get_id())->second.first + level_increase, text));
+    LoggerThreadStates result;
+    for (auto const& entry : _data)
+        if (not entry.second->is_dead())
+            result.insert({entry.first,{entry.second->current_level(),entry.second->thread_name(),entry.second->verbosity_override()}});
+    return result;
 }
 
-void BlockingLoggerScheduler::hold(std::string scope, std::string text) {
+void NonblockingLoggerScheduler::import_thread_states(LoggerThreadStates const& states) {
     std::lock_guard<std::mutex> lock(_data_mutex);
-    Logger::instance()._hold(LogRawMessage(_data.find(std::this_thread::get_id())->second.second, scope, _data.find(std::this_thread::get_id())->second.first, text));
+    for (auto const& entry : states) {
+        auto data = SharedPointer<LoggerData>(new LoggerData(entry.second.level,entry.second.name));
+        data->set_verbosity_override(entry.second.verbosity_override);
+        _data[entry.first] = data;
+        _update_largest_thread_name_size(entry.second.name);
+    }
+    _no_alive_thread_registered = not _are_alive_threads_registered();
 }
 
-void BlockingLoggerScheduler::release(std::string scope) {
-    std::lock_guard<std::mutex> lock(_data_mutex);
-    Logger::instance()._release(LogRawMessage(_data.find(std::this_thread::get_id())->second.second, scope, _data.find(std::this_thread::get_id())->second.first, std::string()));
+NonblockingLoggerScheduler::~NonblockingLoggerScheduler() {
+    // The consumption thread must not outlive the data it reads
+    if (_dequeueing_thread != nullptr) stop();
 }
 
-void BlockingLoggerScheduler::terminate() { }
-
-NonblockingLoggerScheduler::NonblockingLoggerScheduler() : _terminate(false), _no_alive_thread_registered(true), _termination_future(_termination_promise.get_future()) {
+std::future<void> NonblockingLoggerScheduler::flush() {
+    // The consumption thread cannot wait for itself, e.g., when flushing from an operator<< of a deferred format argument
+    if (std::this_thread::get_id() == _consumer_thread_id.load()) return flushed_future();
+    std::future<void> result;
     {
         std::lock_guard<std::mutex> lock(_data_mutex);
-        _data.insert({std::this_thread::get_id(),SharedPointer<LoggerData>(new LoggerData(1,Logger::_MAIN_THREAD_NAME))});
+        // With no queues there are no markers to wait for
+        if (_data.empty()) return flushed_future();
+        auto barrier = std::make_shared<FlushBarrier>(_data.size());
+        result = barrier->future();
+        for (auto const& entry : _data) entry.second->enqueue_barrier(barrier);
     }
-    _dequeueing_thread = std::make_shared<MessageConsumptionThread>([this] { _consume_msgs(); });
+    // Synchronising on the availability mutex guarantees that the notification is not lost
+    std::lock_guard<std::mutex> lock(_message_availability_mutex);
+    _message_availability_condition.notify_one();
+    return result;
 }
 
-void NonblockingLoggerScheduler::terminate() {
+char const* NonblockingLoggerScheduler::kind() const {
+    return "nonblocking";
+}
+
+void NonblockingLoggerScheduler::collect_statistics(LoggerStatistics& statistics) const {
+    LoggerStatistics result;
     {
-        std::unique_lock<std::mutex> lock(_message_availability_mutex);
-        _terminate = true;
-        _message_availability_condition.notify_one();
+        std::lock_guard<std::mutex> lock(_data_mutex);
+        result = _retired_statistics;
+        for (auto const& entry : _data) {
+            entry.second->add_statistics(result);
+            result.queue_depth += entry.second->queue_size();
+        }
     }
-    _termination_future.get();
+    result.messages_written = _num_written.load(std::memory_order_relaxed);
+    result.bytes_written = _num_written_bytes.load(std::memory_order_relaxed);
+    auto now = steady_clock_ns();
+    auto end = _consumer_end_ns.load();
+    auto idle_since = _consumer_idle_since_ns.load();
+    auto start = std::chrono::duration_cast<std::chrono::nanoseconds>(_consumer_start.time_since_epoch()).count();
+    auto idle = static_cast<int64_t>(_consumer_idle_ns.load()) + (end == 0 and idle_since != 0 ? now - idle_since : 0);
+    auto elapsed = (end != 0 ? end : now) - start;
+    result.consumer_idle_time = std::chrono::nanoseconds(idle);
+    result.consumer_busy_time = std::chrono::nanoseconds(std::max(elapsed - idle, int64_t(0)));
+    accumulate_statistics(statistics,result);
 }
 
-NonblockingLoggerScheduler::~NonblockingLoggerScheduler() { }
+void NonblockingLoggerScheduler::emergency_flush(int fd) const {
+    // The data mutex is deliberately not acquired, since the interrupted thread may be holding it
+    for (auto const& entry : _data) entry.second->emergency_write(fd);
+}
 
-void NonblockingLoggerScheduler::create_data_instance(std::thread::id id, std::string name) {
-    create_data_instance(id,name,current_level());
+SharedPointer<LoggerData> NonblockingLoggerScheduler::data_instance(std::thread::id id) const {
+    std::lock_guard<std::mutex> lock(_data_mutex);
+    auto entry = _data.find(id);
+    return (entry != _data.end() ? entry->second : nullptr);
 }
 
 void NonblockingLoggerScheduler::create_data_instance(std::thread::id id, std::string name, unsigned int level) {
     std::lock_guard<std::mutex> lock(_data_mutex);
-    // Won't replace if it already exists
-    _data.insert({id,SharedPointer<LoggerData>(new LoggerData(level,name))});
+    // Won't replace if it already exists, but a dead instance is reused since thread ids can be recycled
+    auto entry = _data.find(id);
+    if (entry == _data.end()) _data.insert({id,SharedPointer<LoggerData>(new LoggerData(level,name))});
+    else if (entry->second->is_dead()) entry->second->revive(level,name);
+    else return;
+    _update_largest_thread_name_size(name);
     if (name != Logger::_MAIN_THREAD_NAME) {
         _no_alive_thread_registered = false;
         _message_availability_condition.notify_one();
@@ -459,7 +1833,14 @@ void NonblockingLoggerScheduler::create_data_instance(std::thread::id id, std::s
 void NonblockingLoggerScheduler::kill_data_instance(std::thread::id id) {
     std::unique_lock<std::mutex> lock(_data_mutex);
     auto entry = _data.find(id);
-    if (entry != _data.end()) entry->second->kill();
+    if (entry != _data.end()) {
+        entry->second->kill();
+        // Otherwise removed by the consumption thread once emptied
+        if (entry->second->queue_size() == 0) {
+            entry->second->add_statistics(_retired_statistics);
+            _data.erase(entry);
+        }
+    }
 
     if (not _are_alive_threads_registered()) {
         _no_alive_thread_registered = true;
@@ -468,83 +1849,129 @@ void NonblockingLoggerScheduler::kill_data_instance(std::thread::id id) {
 }
 
 bool NonblockingLoggerScheduler::_are_alive_threads_registered() const {
-    for (auto d : _data)
-        if (d.second->thread_name() != Logger::_MAIN_THREAD_NAME and not d.second->is_dead()) return true;
+    for (auto const& d : _data)
+        if (d.second->dequeued_thread_name() != Logger::_MAIN_THREAD_NAME and not d.second->is_dead()) return true;
     return false;
 }
 
-unsigned int NonblockingLoggerScheduler::current_level() const {
-    return _data.find(std::this_thread::get_id())->second->current_level();
+void NonblockingLoggerScheduler::_update_largest_thread_name_size(std::string const& name) {
+    // Renaming threads update concurrently
+    SizeType largest = _largest_thread_name_size;
+    while (name.size() > largest and not _largest_thread_name_size.compare_exchange_weak(largest,name.size())) { }
 }
 
-std::string NonblockingLoggerScheduler::current_thread_name() const {
-    return _data.find(std::this_thread::get_id())->second->thread_name();
+SizeType NonblockingLoggerScheduler::largest_thread_name_size() const {
+    return _largest_thread_name_size;
 }
 
-SizeType NonblockingLoggerScheduler::largest_thread_name_size() const {
-    SizeType result = 0;
-    for (auto entry : _data) result = std::max(result,entry.second->thread_name().size());
-    return result;
+void NonblockingLoggerScheduler::println(LoggerData& data, unsigned int level_increase, std::string&& text) {
+    // Copied into the queue, so that the capacity of the text stays with the thread
+    data.enqueue_println(level_increase,text);
+    _message_availability_condition.notify_one();
 }
 
-void NonblockingLoggerScheduler::increase_level(unsigned int i) {
-    std::lock_guard<std::mutex> lock(_data_mutex);
-    _data.find(std::this_thread::get_id())->second->increase_level(i);
+void NonblockingLoggerScheduler::println(LoggerData& data, unsigned int level_increase, std::string_view text) {
+    data.enqueue_println(level_increase,text);
+    _message_availability_condition.notify_one();
 }
 
-void NonblockingLoggerScheduler::decrease_level(unsigned int i) {
-    std::lock_guard<std::mutex> lock(_data_mutex);
-    _data.find(std::this_thread::get_id())->second->decrease_level(i);
+void NonblockingLoggerScheduler::println_static(LoggerData& data, unsigned int level_increase, std::string_view text) {
+    data.enqueue_println_static(level_increase,text);
+    _message_availability_condition.notify_one();
 }
 
-void NonblockingLoggerScheduler::println(unsigned int level_increase, std::string text) {
-    std::lock_guard<std::mutex> lock(_data_mutex);
-    _data.find(std::this_thread::get_id())->second->enqueue_println(level_increase,text);
+void NonblockingLoggerScheduler::println_deferred(LoggerData& data, unsigned int level_increase, LogDeferredFormat const& format, std::string&& arguments) {
+    data.enqueue_println_deferred(level_increase,format,arguments);
     _message_availability_condition.notify_one();
 }
 
-void NonblockingLoggerScheduler::hold(std::string scope, std::string text) {
-    std::lock_guard<std::mutex> lock(_data_mutex);
-    _data.find(std::this_thread::get_id())->second->enqueue_hold(scope,text);
+void NonblockingLoggerScheduler::hold(LoggerData& data, std::string_view scope, std::string&& text) {
+    data.enqueue_hold(scope,text);
     _message_availability_condition.notify_one();
 }
 
-void NonblockingLoggerScheduler::release(std::string scope) {
-    std::lock_guard<std::mutex> lock(_data_mutex);
-    _data.find(std::this_thread::get_id())->second->enqueue_release(scope);
+void NonblockingLoggerScheduler::hold(LoggerData& data, std::string_view scope, std::string_view text) {
+    data.enqueue_hold(scope,text);
+    _message_availability_condition.notify_one();
+}
+
+void NonblockingLoggerScheduler::release(LoggerData& data, std::string_view scope) {
+    data.enqueue_release(scope);
+    _message_availability_condition.notify_one();
+}
+
+void NonblockingLoggerScheduler::set_logical_name(LoggerData& data, std::string name) {
+    _update_largest_thread_name_size(name);
+    data.enqueue_logical_name(name);
     _message_availability_condition.notify_one();
 }
 
 bool NonblockingLoggerScheduler::_is_queue_empty() const {
     std::lock_guard<std::mutex> lock(_data_mutex);
-    for (auto entry : _data) {
+    for (auto const& entry : _data) {
         if (entry.second->queue_size() > 0) return false;
     }
     return true;
 }
 
-LogRawMessage NonblockingLoggerScheduler::_dequeue() {
+bool NonblockingLoggerScheduler::_dequeue(std::string& thread_name, LogThinRawMessage& msg, LogDeferredFormat& deferred_format, SharedPointer<FlushBarrier>& barrier) {
     SharedPointer<LoggerData> largest_data;
     SizeType largest_size = 0;
     std::lock_guard<std::mutex> lock(_data_mutex);
-    auto it = _data.begin();
-    while (it != _data.end()) {
+    auto largest_it = _data.end();
+    for (auto it = _data.begin(); it != _data.end(); ++it) {
         SizeType size = it->second->queue_size();
         if (size > largest_size) {
-            largest_data = it->second;
+            largest_it = it;
             largest_size = size;
         }
-        ++it;
     }
-    return LogRawMessage(largest_data->thread_name(),largest_data->dequeue());
+    largest_data = largest_it->second;
+    bool const is_message = largest_data->dequeue(msg, deferred_format, barrier);
+    thread_name.assign(largest_data->dequeued_thread_name());
+    if (largest_data->is_dead() and largest_data->queue_size() == 0) {
+        largest_data->add_statistics(_retired_statistics);
+        _data.erase(largest_it);
+    }
+    return is_message;
 }
 
+// The scheduler whose messages are written by a consumption thread, null for other threads
+thread_local LoggerSchedulerInterface const* this_thread_consumed_scheduler = nullptr;
+
 void NonblockingLoggerScheduler::_consume_msgs() {
+    _consumer_thread_id = std::this_thread::get_id();
+    this_thread_consumed_scheduler = this;
+    // Reused across messages, so that their strings keep their capacity
+    LogRawMessage msg(std::string(),0,std::string());
+    LogDeferredFormat deferred_format{nullptr,nullptr};
+    SharedPointer<FlushBarrier> barrier;
     while(true) {
         std::unique_lock<std::mutex> lock(_message_availability_mutex);
-        _message_availability_condition.wait(lock, [this] { return (_terminate and _no_alive_thread_registered) or not _is_queue_empty(); });
-        if (_terminate and _no_alive_thread_registered and _is_queue_empty()) { _termination_promise.set_value(); return; }
-        auto msg = _dequeue();
+        auto has_work = [this] { return (_terminate and _no_alive_thread_registered) or not _is_queue_empty(); };
+        if (not has_work()) {
+            auto idle_start = steady_clock_ns();
+            _consumer_idle_since_ns = idle_start;
+            _message_availability_condition.wait(lock, has_work);
+            _consumer_idle_since_ns = 0;
+            add_to_counter(_consumer_idle_ns, static_cast<uint64_t>(steady_clock_ns() - idle_start));
+        }
+        if (_terminate and _no_alive_thread_registered and _is_queue_empty()) {
+            _consumer_end_ns = steady_clock_ns();
+            _termination_promise.set_value();
+            return;
+        }
+        lock.unlock();
+        bool const is_message = _dequeue(msg.identifier,msg,deferred_format,barrier);
+        if (barrier != nullptr) {
+            barrier->arrive();
+            barrier.reset();
+            continue;
+        }
+        if (not is_message) continue;
+        if (deferred_format.write != nullptr) write_deferred_text(msg.text, deferred_format, msg.text);
+        add_to_counter(_num_written, SizeType(1));
+        add_to_counter(_num_written_bytes, msg.text.size());
         switch (msg.kind()) {
             default : [[fallthrough]];
             case RawMessageKind::PRINTLN : Logger::instance()._println(msg); break;
@@ -564,125 +1991,334 @@ OutputStream& operator<<(OutputStream& os, const ThreadNamePrintingPolicy& p) {
     return os;
 }
 
-LoggerConfiguration::LoggerConfiguration() :
-        _verbosity(0), _indents_based_on_level(true), _prints_level_on_change_only(true), _prints_scope_entrance(false),
-        _prints_scope_exit(false), _handles_multiline_output(true), _discards_newlines_and_indentation(false),
-        _thread_name_printing_policy(ThreadNamePrintingPolicy::NEVER),
-        _theme(TT_THEME_NONE)
-{ }
+OutputStream& operator<<(OutputStream& os, const LogOutputFormat& f) {
+    switch(f) {
+        default : [[fallthrough]];
+        case LogOutputFormat::TEXT : os << "TEXT"; break;
+        case LogOutputFormat::NDJSON : os << "NDJSON"; break;
+    }
+    return os;
+}
+
+namespace {
+
+// The keywords styled by the theme, in addition to the custom ones
+const char* const DEFAULT_KEYWORDS[] = { "virtual", "const", "true", "false", "inf" };
+
+void compile_keyword_styles(LoggerConfigurationSnapshot& configuration) {
+    configuration.keyword_styles.clear();
+    for (auto keyword : DEFAULT_KEYWORDS) configuration.keyword_styles.insert({keyword,configuration.theme.keyword()});
+    for (auto const& kw : configuration.custom_keywords) configuration.keyword_styles.insert({kw.first,kw.second()});
+}
+
+void compile_theme(LoggerConfigurationSnapshot& configuration) {
+    auto const& theme = configuration.theme;
+    auto& codes = configuration.theme_codes;
+    codes.has_style = theme.has_style();
+    codes.level_number = theme.level_number();
+    codes.level_shown_separator = theme.level_shown_separator();
+    codes.level_hidden_separator = theme.level_hidden_separator();
+    codes.multiline_separator = theme.multiline_separator();
+    codes.at = theme.at();
+    for (auto& text : codes.characters) text.clear();
+    auto style = [&](char const* characters, TerminalTextStyle const& s) {
+        auto code = s();
+        for (; *characters != 0; ++characters)
+            codes.characters[static_cast<unsigned char>(*characters)] = code + *characters + TerminalTextStyle::RESET;
+    };
+    style("=><!",theme.assignment_comparison);
+    style("()",theme.round_parentheses);
+    style("[]",theme.square_parentheses);
+    style("{}",theme.curly_parentheses);
+    style(":",theme.colon);
+    style(",",theme.comma);
+    style("@",theme.at);
+    style(".0123456789",theme.number);
+    style("+-*/\\^|&%",theme.miscellaneous_operator);
+}
+
+} // namespace
+
+// The source of the versions of the snapshots, shared by all the configurations; zero stands for no snapshot
+std::atomic<uint64_t> last_configuration_version(0);
+
+//! \brief The snapshot of a configuration last loaded by a thread
+struct ThisThreadConfigurationSnapshot {
+    uint64_t version = 0;
+    SharedPointer<LoggerConfigurationSnapshot const> snapshot;
+};
+
+thread_local ThisThreadConfigurationSnapshot this_thread_configuration_snapshot;
+
+LoggerConfiguration::LoggerConfiguration() {
+    auto snapshot = std::make_shared<LoggerConfigurationSnapshot>();
+    snapshot->verbosity = 0;
+    snapshot->indents_based_on_level = true;
+    snapshot->prints_level_on_change_only = true;
+    snapshot->prints_scope_entrance = false;
+    snapshot->prints_scope_exit = false;
+    snapshot->handles_multiline_output = true;
+    snapshot->discards_newlines_and_indentation = false;
+    snapshot->thread_name_printing_policy = ThreadNamePrintingPolicy::NEVER;
+    snapshot->output_format = LogOutputFormat::TEXT;
+    snapshot->recorder_verbosity = 0;
+    snapshot->recorder_capacity = 4096;
+    snapshot->profiles_scopes = false;
+    snapshot->statistics_summary_period = std::chrono::milliseconds(0);
+    snapshot->traces_latency = false;
+    snapshot->payload_chunk_size = 1024;
+    snapshot->theme = TT_THEME_NONE;
+    compile_theme(*snapshot);
+    compile_keyword_styles(*snapshot);
+    std::atomic_store(&_snapshot,SharedPointer<LoggerConfigurationSnapshot const>(std::move(snapshot)));
+    _version = ++last_configuration_version;
+}
+
+template<class F> void LoggerConfiguration::_update(F const& change) {
+    std::lock_guard<std::mutex> lock(_update_mutex);
+    auto snapshot = std::make_shared<LoggerConfigurationSnapshot>(*std::atomic_load(&_snapshot));
+    change(*snapshot);
+    compile_theme(*snapshot);
+    compile_keyword_styles(*snapshot);
+    // The version is changed after the snapshot, so that a thread seeing the new version loads the new snapshot
+    std::atomic_store(&_snapshot,SharedPointer<LoggerConfigurationSnapshot const>(std::move(snapshot)));
+    _version.store(++last_configuration_version,std::memory_order_release);
+}
+
+LoggerConfigurationSnapshot const& LoggerConfiguration::_cached_snapshot() const {
+    auto& cache = this_thread_configuration_snapshot;
+    auto version = _version.load(std::memory_order_acquire);
+    if (cache.version != version) {
+        // Replacing the cached snapshot releases the previous one, unless other threads still use it
+        cache.snapshot = std::atomic_load(&_snapshot);
+        cache.version = version;
+    }
+    return *cache.snapshot;
+}
+
+SharedPointer<LoggerConfigurationSnapshot const> LoggerConfiguration::snapshot() const {
+    _cached_snapshot();
+    return this_thread_configuration_snapshot.snapshot;
+}
 
 LoggerConfiguration& Logger::configuration() {
     return _configuration;
 }
 
 void LoggerConfiguration::set_verbosity(unsigned int v) {
-    _verbosity = v;
+    _update([&](LoggerConfigurationSnapshot& values) { values.verbosity = v; });
 }
 
 void LoggerConfiguration::set_indents_based_on_level(bool b) {
-    _indents_based_on_level = b;
+    _update([&](LoggerConfigurationSnapshot& values) { values.indents_based_on_level = b; });
 }
 
 void LoggerConfiguration::set_prints_level_on_change_only(bool b) {
-    _prints_level_on_change_only = b;
+    _update([&](LoggerConfigurationSnapshot& values) { values.prints_level_on_change_only = b; });
 }
 
 void LoggerConfiguration::set_prints_scope_entrance(bool b) {
-    _prints_scope_entrance = b;
+    _update([&](LoggerConfigurationSnapshot& values) { values.prints_scope_entrance = b; });
 }
 
 void LoggerConfiguration::set_prints_scope_exit(bool b) {
-    _prints_scope_exit = b;
+    _update([&](LoggerConfigurationSnapshot& values) { values.prints_scope_exit = b; });
 }
 
 void LoggerConfiguration::set_handles_multiline_output(bool b) {
-    _handles_multiline_output = b;
+    _update([&](LoggerConfigurationSnapshot& values) { values.handles_multiline_output = b; });
 }
 
 void LoggerConfiguration::set_discards_newlines_and_indentation(bool b) {
-    _discards_newlines_and_indentation = b;
+    _update([&](LoggerConfigurationSnapshot& values) { values.discards_newlines_and_indentation = b; });
 }
 
 void LoggerConfiguration::set_thread_name_printing_policy(ThreadNamePrintingPolicy p) {
-    _thread_name_printing_policy = p;
+    _update([&](LoggerConfigurationSnapshot& values) { values.thread_name_printing_policy = p; });
+}
+
+void LoggerConfiguration::set_output_format(LogOutputFormat f) {
+    _update([&](LoggerConfigurationSnapshot& values) { values.output_format = f; });
+}
+
+void LoggerConfiguration::set_verbosity_filters(std::string const& filters) {
+    auto parsed = parse_verbosity_filters(filters);
+    // Under the update lock, so that the filters of the registry and the configuration are changed in the same order
+    _update([&](LoggerConfigurationSnapshot& values) {
+        LogCallsiteRegistry::instance().set_verbosity_filters(parsed);
+        values.verbosity_filters = filters;
+    });
+}
+
+void LoggerConfiguration::set_recorder_verbosity(unsigned int v) {
+    _update([&](LoggerConfigurationSnapshot& values) { values.recorder_verbosity = v; });
+}
+
+void LoggerConfiguration::set_recorder_capacity(SizeType c) {
+    _update([&](LoggerConfigurationSnapshot& values) { values.recorder_capacity = c; });
+}
+
+void LoggerConfiguration::set_profiles_scopes(bool b) {
+    _update([&](LoggerConfigurationSnapshot& values) { values.profiles_scopes = b; });
+}
+
+void LoggerConfiguration::set_statistics_summary_period(std::chrono::milliseconds p) {
+    _update([&](LoggerConfigurationSnapshot& values) { values.statistics_summary_period = p; });
+}
+
+void LoggerConfiguration::set_traces_latency(bool b) {
+    _update([&](LoggerConfigurationSnapshot& values) { values.traces_latency = b; });
+}
+
+void LoggerConfiguration::set_payload_chunk_size(SizeType s) {
+    _update([&](LoggerConfigurationSnapshot& values) { values.payload_chunk_size = s; });
 }
 
 void LoggerConfiguration::set_theme(TerminalTextTheme const& theme) {
-    _theme = theme;
+    _update([&](LoggerConfigurationSnapshot& values) { values.theme = theme; });
 }
 
 unsigned int LoggerConfiguration::verbosity() const {
-    return _verbosity;
+    return _cached_snapshot().verbosity;
+}
+
+std::string LoggerConfiguration::verbosity_filters() const {
+    return _cached_snapshot().verbosity_filters;
 }
 
 bool LoggerConfiguration::indents_based_on_level() const {
-    return _indents_based_on_level;
+    return _cached_snapshot().indents_based_on_level;
 }
 
 bool LoggerConfiguration::prints_level_on_change_only() const {
-    return _prints_level_on_change_only;
+    return _cached_snapshot().prints_level_on_change_only;
 }
 
 bool LoggerConfiguration::prints_scope_entrance() const {
-    return _prints_scope_entrance;
+    return _cached_snapshot().prints_scope_entrance;
 }
 
 bool LoggerConfiguration::prints_scope_exit() const {
-    return _prints_scope_exit;
+    return _cached_snapshot().prints_scope_exit;
 }
 
 bool LoggerConfiguration::handles_multiline_output() const {
-    return _handles_multiline_output;
+    return _cached_snapshot().handles_multiline_output;
 }
 
 bool LoggerConfiguration::discards_newlines_and_indentation() const {
-    return _discards_newlines_and_indentation;
+    return _cached_snapshot().discards_newlines_and_indentation;
 }
 
 ThreadNamePrintingPolicy LoggerConfiguration::thread_name_printing_policy() const {
-    return _thread_name_printing_policy;
+    return _cached_snapshot().thread_name_printing_policy;
+}
+
+LogOutputFormat LoggerConfiguration::output_format() const {
+    return _cached_snapshot().output_format;
+}
+
+unsigned int LoggerConfiguration::recorder_verbosity() const {
+    return _cached_snapshot().recorder_verbosity;
+}
+
+SizeType LoggerConfiguration::recorder_capacity() const {
+    return _cached_snapshot().recorder_capacity;
+}
+
+bool LoggerConfiguration::profiles_scopes() const {
+    return _cached_snapshot().profiles_scopes;
+}
+
+std::chrono::milliseconds LoggerConfiguration::statistics_summary_period() const {
+    return _cached_snapshot().statistics_summary_period;
+}
+
+bool LoggerConfiguration::traces_latency() const {
+    return _cached_snapshot().traces_latency;
+}
+
+SizeType LoggerConfiguration::payload_chunk_size() const {
+    return _cached_snapshot().payload_chunk_size;
 }
 
-TerminalTextTheme const& LoggerConfiguration::theme() const {
-    return _theme;
+TerminalTextTheme LoggerConfiguration::theme() const {
+    return _cached_snapshot().theme;
 }
 
 void LoggerConfiguration::add_custom_keyword(std::string const& text, TerminalTextStyle const& style) {
-    _custom_keywords.insert({text,style});
+    _update([&](LoggerConfigurationSnapshot& values) { values.custom_keywords.insert({text,style}); });
 }
 
 void LoggerConfiguration::add_custom_keyword(std::string const& text) {
-    add_custom_keyword(text,theme().keyword);
+    _update([&](LoggerConfigurationSnapshot& values) { values.custom_keywords.insert({text,values.theme.keyword}); });
 }
 
-std::map<std::string,TerminalTextStyle> const& LoggerConfiguration::custom_keywords() const {
-    return _custom_keywords;
+std::map<std::string,TerminalTextStyle> LoggerConfiguration::custom_keywords() const {
+    return _cached_snapshot().custom_keywords;
 }
 
-OutputStream& operator<<(OutputStream& os, LoggerConfiguration const& c) {
+OutputStream& operator<<(OutputStream& os, LoggerConfiguration const& configuration) {
+    auto snapshot = configuration.snapshot();
+    auto const& c = *snapshot;
     os << "LoggerConfiguration("
-       << "\n  verbosity=" << c._verbosity
-       << ",\n  indents_based_on_level=" << c._indents_based_on_level
-       << ",\n  prints_level_on_change_only=" << c._prints_level_on_change_only
-       << ",\n  prints_scope_entrance=" << c._prints_scope_entrance
-       << ",\n  prints_scope_exit=" << c._prints_scope_exit
-       << ",\n  handles_multiline_output=" << c._handles_multiline_output
-       << ",\n  discards_newlines_and_indentation=" << c._discards_newlines_and_indentation
-       << ",\n  thread_name_printing_policy=" << c._thread_name_printing_policy
+       << "\n  verbosity=" << c.verbosity
+       << ",\n  verbosity_filters=\"" << c.verbosity_filters << "\""
+       << ",\n  indents_based_on_level=" << c.indents_based_on_level
+       << ",\n  prints_level_on_change_only=" << c.prints_level_on_change_only
+       << ",\n  prints_scope_entrance=" << c.prints_scope_entrance
+       << ",\n  prints_scope_exit=" << c.prints_scope_exit
+       << ",\n  handles_multiline_output=" << c.handles_multiline_output
+       << ",\n  discards_newlines_and_indentation=" << c.discards_newlines_and_indentation
+       << ",\n  thread_name_printing_policy=" << c.thread_name_printing_policy
+       << ",\n  output_format=" << c.output_format
+       << ",\n  recorder_verbosity=" << c.recorder_verbosity
+       << ",\n  recorder_capacity=" << c.recorder_capacity
+       << ",\n  profiles_scopes=" << c.profiles_scopes
+       << ",\n  statistics_summary_period=" << c.statistics_summary_period.count() << "ms"
+       << ",\n  traces_latency=" << c.traces_latency
+       << ",\n  payload_chunk_size=" << c.payload_chunk_size
        << ",\n  theme=(not shown)" // To show theme colors appropriately, print the theme object directly on standard output
        << "\n)";
     return os;
 }
 
+OutputStream& operator<<(OutputStream& os, LoggerStatistics const& s) {
+    os << "LoggerStatistics(messages_enqueued=" << s.messages_enqueued
+       << ", bytes_enqueued=" << s.bytes_enqueued
+       << ", messages_written=" << s.messages_written
+       << ", bytes_written=" << s.bytes_written
+       << ", queue_depth=" << s.queue_depth
+       << ", queue_high_water=" << s.queue_high_water
+       << ", producer_blocked_time=" << s.producer_blocked_time.count() << "ns"
+       << ", consumer_busy_time=" << s.consumer_busy_time.count() << "ns"
+       << ", consumer_idle_time=" << s.consumer_idle_time.count() << "ns"
+       << ", payload_chunks_allocated=" << s.payload_chunks_allocated
+       << ", payload_bytes_allocated=" << s.payload_bytes_allocated
+       << ", payload_chunks_reused=" << s.payload_chunks_reused << ")";
+    return os;
+}
+
 Logger::Logger() :
     _cached_num_held_columns(0), _cached_last_printed_level(0), _cached_last_printed_thread_name(std::string()),
-    _scheduler(std::make_shared<NonblockingLoggerScheduler>()) { }
+    _scheduler_instance(std::make_shared<NonblockingLoggerScheduler>()), _scheduler(_scheduler_instance.get()), _scheduler_generation(1),
+    _is_tracing(false), _trace_session(0), _num_traced_threads(0), _next_statistics_summary(0) {
+    is_logger_alive = true;
+}
 
 const std::string Logger::_MAIN_THREAD_NAME = "main";
 const unsigned int Logger::_MUTE_LEVEL_OFFSET = 1024;
 
 Logger::~Logger() {
-    _scheduler->terminate();
+    is_logger_alive = false;
+    stop_tracing();
+    {
+        // Threads registered automatically may outlive the logger, hence they must not delay termination
+        std::shared_lock<std::shared_mutex> lock(_scheduler_mutex);
+        std::lock_guard<std::mutex> registered_lock(_automatically_registered_threads_mutex);
+        for (auto id : _automatically_registered_threads) _scheduler.load()->kill_data_instance(id);
+    }
+    _scheduler.load()->terminate();
 }
 
 void Logger::attach_thread_registry(ThreadRegistryInterface* registry) {
@@ -696,113 +2332,564 @@ bool Logger::has_thread_registry_attached() const {
 
 void Logger::use_immediate_scheduler() {
     if (not has_thread_registry_attached()) throw LoggerNoThreadRegistryException();
-    if (_thread_registry->has_threads_registered()) throw LoggerSchedulerChangeWithRegisteredThreadsException();
-    else _scheduler->terminate();
-    _scheduler.reset(new ImmediateLoggerScheduler());
+    _use_scheduler(std::make_shared<ImmediateLoggerScheduler>());
 }
 
 void Logger::use_blocking_scheduler() {
     if (not has_thread_registry_attached()) throw LoggerNoThreadRegistryException();
-    if (_thread_registry->has_threads_registered()) throw LoggerSchedulerChangeWithRegisteredThreadsException();
-    else _scheduler->terminate();
-    _scheduler.reset(new BlockingLoggerScheduler());
+    _use_scheduler(std::make_shared<BlockingLoggerScheduler>());
 }
 
 void Logger::use_nonblocking_scheduler() {
     if (not has_thread_registry_attached()) throw LoggerNoThreadRegistryException();
-    if (_thread_registry->has_threads_registered()) throw LoggerSchedulerChangeWithRegisteredThreadsException();
-    else _scheduler->terminate();
-    _scheduler.reset(new NonblockingLoggerScheduler());
+    _use_scheduler(std::make_shared<NonblockingLoggerScheduler>());
+}
+
+void Logger::_use_scheduler(SharedPointer<LoggerSchedulerInterface> scheduler) {
+    std::lock_guard<std::mutex> change_lock(_scheduler_change_mutex);
+    SharedPointer<LoggerSchedulerInterface> previous;
+    {
+        // Submissions are paused only while the thread states are transferred
+        std::unique_lock<std::shared_mutex> lock(_scheduler_mutex);
+        std::lock_guard<std::mutex> retired_lock(_retired_statistics_mutex);
+        previous = _scheduler_instance;
+        scheduler->import_thread_states(previous->thread_states());
+        _scheduler_instance = scheduler;
+        _scheduler.store(scheduler.get());
+        ++_scheduler_generation;
+        _draining_scheduler = previous;
+    }
+    // The messages enqueued so far are written while the new scheduler already accepts submissions
+    previous->stop();
+    std::lock_guard<std::mutex> retired_lock(_retired_statistics_mutex);
+    previous->collect_statistics(_retired_statistics);
+    _draining_scheduler.reset();
 }
 
 void Logger::redirect_to_console() {
     if(_redirect_file.is_open()) _redirect_file.close();
+    _redirect_filename.clear();
     std::clog.rdbuf(_default_streambuf);
 }
 
 void Logger::redirect_to_file(const char* filename) {
     if(_redirect_file.is_open()) _redirect_file.close();
     _redirect_file.open(filename);
+    _redirect_filename = filename;
     _default_streambuf = std::clog.rdbuf();
     std::clog.rdbuf( _redirect_file.rdbuf() );
 }
 
 void Logger::register_thread(std::thread::id id, std::string name) {
     if (not has_thread_registry_attached()) throw LoggerNoThreadRegistryException();
-    auto nbls = dynamic_cast<NonblockingLoggerScheduler*>(_scheduler.get());
-    auto bls = dynamic_cast<BlockingLoggerScheduler*>(_scheduler.get());
-    if (nbls != nullptr) nbls->create_data_instance(id,name);
-    else if (bls != nullptr) bls->create_data_instance(id,name);
+    std::shared_lock<std::shared_mutex> lock(_scheduler_mutex);
+    auto scheduler = _scheduler.load();
+    _register_thread(scheduler,id,name,_this_thread_data(scheduler).current_level());
 }
 
 void Logger::register_self_thread(std::string name, unsigned int level) {
     if (not has_thread_registry_attached()) throw LoggerNoThreadRegistryException();
-    auto nbls = dynamic_cast<NonblockingLoggerScheduler*>(_scheduler.get());
-    auto bls = dynamic_cast<BlockingLoggerScheduler*>(_scheduler.get());
-    if (nbls != nullptr) nbls->create_data_instance(std::this_thread::get_id(),name,level);
-    else if (bls != nullptr) bls->create_data_instance(std::this_thread::get_id(),name,level);
+    std::shared_lock<std::shared_mutex> lock(_scheduler_mutex);
+    _register_thread(_scheduler.load(),std::this_thread::get_id(),name,level);
+}
+
+void Logger::_register_thread(LoggerSchedulerInterface* scheduler, std::thread::id id, std::string name, unsigned int level) {
+    {
+        // An explicit registration replaces an automatic one
+        std::lock_guard<std::mutex> registered_lock(_automatically_registered_threads_mutex);
+        if (_automatically_registered_threads.erase(id) > 0) scheduler->kill_data_instance(id);
+    }
+    scheduler->create_data_instance(id,name,level);
+    if (id == std::this_thread::get_id()) this_thread_logger_data.is_automatically_registered = false;
 }
 
 void Logger::unregister_thread(std::thread::id id) {
     if (not has_thread_registry_attached()) throw LoggerNoThreadRegistryException();
-    auto nbls = dynamic_cast<NonblockingLoggerScheduler*>(_scheduler.get());
-    auto bls = dynamic_cast<BlockingLoggerScheduler*>(_scheduler.get());
-    if (nbls != nullptr) nbls->kill_data_instance(id);
-    else if (bls != nullptr) bls->kill_data_instance(id);
+    std::shared_lock<std::shared_mutex> lock(_scheduler_mutex);
+    _scheduler.load()->kill_data_instance(id);
+}
+
+void Logger::_unregister_automatically_registered_thread() {
+    auto id = std::this_thread::get_id();
+    std::shared_lock<std::shared_mutex> lock(_scheduler_mutex);
+    std::lock_guard<std::mutex> registered_lock(_automatically_registered_threads_mutex);
+    if (_automatically_registered_threads.erase(id) > 0) _scheduler.load()->kill_data_instance(id);
+}
+
+LoggerData& Logger::_this_thread_data(LoggerSchedulerInterface* scheduler) const {
+    auto& cache = this_thread_logger_data;
+    // The generation is stable while holding the scheduler mutex, and unlike the address it is never reused
+    auto generation = _scheduler_generation.load();
+    if (cache.scheduler_generation != generation or cache.data->is_dead()) {
+        auto id = std::this_thread::get_id();
+        auto data = scheduler->data_instance(id);
+        if (data == nullptr) {
+            std::ostringstream name;
+            name << id;
+            {
+                std::lock_guard<std::mutex> registered_lock(_automatically_registered_threads_mutex);
+                _automatically_registered_threads.insert(id);
+            }
+            scheduler->create_data_instance(id,name.str(),1);
+            data = scheduler->data_instance(id);
+            cache.is_automatically_registered = true;
+        }
+        cache.scheduler_generation = generation;
+        cache.data = data;
+    }
+    return *cache.data;
+}
+
+LoggerSchedulerInterface const& Logger::_writing_scheduler() const {
+    // Other threads write while submitting, hence for the current scheduler
+    return (this_thread_consumed_scheduler != nullptr ? *this_thread_consumed_scheduler : *_scheduler.load());
+}
+
+LoggerData& Logger::_this_thread_data() const {
+    auto& cache = this_thread_logger_data;
+    if (cache.scheduler_generation == _scheduler_generation.load() and not cache.data->is_dead()) return *cache.data;
+    std::shared_lock<std::shared_mutex> lock(_scheduler_mutex);
+    return _this_thread_data(_scheduler.load());
 }
 
 void Logger::increase_level(unsigned int i) {
-    _scheduler->increase_level(i);
+    std::shared_lock<std::shared_mutex> lock(_scheduler_mutex);
+    _this_thread_data(_scheduler.load()).increase_level(i);
 }
 
 void Logger::decrease_level(unsigned int i) {
-    _scheduler->decrease_level(i);
+    std::shared_lock<std::shared_mutex> lock(_scheduler_mutex);
+    _this_thread_data(_scheduler.load()).decrease_level(i);
 }
 
 void Logger::mute_increase_level() {
-    _scheduler->increase_level(_MUTE_LEVEL_OFFSET);
+    increase_level(_MUTE_LEVEL_OFFSET);
 }
 
 void Logger::mute_decrease_level() {
-    _scheduler->decrease_level(_MUTE_LEVEL_OFFSET);
+    decrease_level(_MUTE_LEVEL_OFFSET);
+}
+
+unsigned int Logger::_verbosity_of(LoggerData const& data, unsigned int filtered_verbosity) const {
+    auto verbosity = data.verbosity_override();
+    if (verbosity != LoggerData::NO_VERBOSITY_OVERRIDE) return verbosity;
+    return (filtered_verbosity != LogCallsite::UNFILTERED ? filtered_verbosity : _configuration.verbosity());
 }
 
 bool Logger::is_muted_at(unsigned int i) const {
-    return (_configuration.verbosity() < current_level()+i);
+    auto const& data = _this_thread_data();
+    return (_verbosity_of(data,LogCallsite::UNFILTERED) < data.current_level()+i);
+}
+
+bool Logger::is_recorded_at(unsigned int i) const {
+    auto const& data = _this_thread_data();
+    auto recorder_verbosity = _configuration.recorder_verbosity();
+    return (recorder_verbosity > _verbosity_of(data,LogCallsite::UNFILTERED) and recorder_verbosity >= data.current_level()+i);
+}
+
+bool Logger::is_muted_at(unsigned int i, LogCallsite const& callsite) const {
+    auto const& data = _this_thread_data();
+    return (_verbosity_of(data,callsite.verbosity()) < data.current_level()+i);
+}
+
+bool Logger::is_recorded_at(unsigned int i, LogCallsite const& callsite) const {
+    auto const& data = _this_thread_data();
+    auto recorder_verbosity = _configuration.recorder_verbosity();
+    return (recorder_verbosity > _verbosity_of(data,callsite.verbosity()) and recorder_verbosity >= data.current_level()+i);
+}
+
+void Logger::set_thread_verbosity(std::thread::id id, unsigned int v) {
+    std::shared_lock<std::shared_mutex> lock(_scheduler_mutex);
+    auto data = _scheduler.load()->data_instance(id);
+    if (data == nullptr or data->is_dead()) throw LoggerUnknownThreadException();
+    data->set_verbosity_override(v);
+}
+
+void Logger::set_thread_verbosity(std::string const& name, unsigned int v) {
+    std::shared_lock<std::shared_mutex> lock(_scheduler_mutex);
+    auto scheduler = _scheduler.load();
+    bool found = false;
+    for (auto const& entry : scheduler->thread_states()) {
+        if (entry.second.name != name) continue;
+        auto data = scheduler->data_instance(entry.first);
+        if (data == nullptr) continue;
+        data->set_verbosity_override(v);
+        found = true;
+    }
+    if (not found) throw LoggerUnknownThreadException();
+}
+
+void Logger::reset_thread_verbosity(std::thread::id id) {
+    set_thread_verbosity(id,LoggerData::NO_VERBOSITY_OVERRIDE);
+}
+
+void Logger::reset_thread_verbosity(std::string const& name) {
+    set_thread_verbosity(name,LoggerData::NO_VERBOSITY_OVERRIDE);
 }
 
 unsigned int Logger::current_level() const {
-    return _scheduler->current_level();
+    return _this_thread_data().current_level();
 }
 
 std::string Logger::current_thread_name() const {
-    return _scheduler->current_thread_name();
+    auto const& name = _this_thread_data().logical_name();
+    if (not name.empty()) return name;
+    std::ostringstream ss;
+    ss << std::this_thread::get_id();
+    return ss.str();
+}
+
+LogContext Logger::current_context() const {
+    return LogContext(current_level(),current_thread_name(),this_thread_scope_chain);
+}
+
+void Logger::restore_context(LogContext const& context) {
+    std::shared_lock<std::shared_mutex> lock(_scheduler_mutex);
+    auto scheduler = _scheduler.load();
+    auto& data = _this_thread_data(scheduler);
+    data._current_level = context._level;
+    if (data.logical_name() != context._thread_name) scheduler->set_logical_name(data,context._thread_name);
+    this_thread_scope_chain = context._scope_chain;
+}
+
+void Logger::switch_context(LogContext const& context, LogContext& previous) {
+    auto* data = &_this_thread_data();
+    std::shared_lock<std::shared_mutex> lock(_scheduler_mutex,std::defer_lock);
+    bool const changes_logical_name = (data->logical_name() != context._thread_name);
+    if (changes_logical_name) {
+        lock.lock();
+        data = &_this_thread_data(_scheduler.load());
+    }
+    previous._level = data->current_level();
+    if (previous._thread_name != data->logical_name()) previous._thread_name = data->logical_name();
+    if (previous._scope_chain != this_thread_scope_chain) previous._scope_chain = this_thread_scope_chain;
+    data->_current_level = context._level;
+    if (this_thread_scope_chain != context._scope_chain) this_thread_scope_chain = context._scope_chain;
+    if (changes_logical_name) _scheduler.load()->set_logical_name(*data,context._thread_name);
 }
 
 std::string Logger::cached_last_printed_thread_name() const {
     return _cached_last_printed_thread_name;
 }
 
-void Logger::println(unsigned int level_increase, std::string text) {
-    _scheduler->println(level_increase, text);
+void Logger::println(unsigned int level_increase, std::string const& text) {
+    println(level_increase, std::string_view(text));
+}
+
+void Logger::println(unsigned int level_increase, std::string&& text) {
+    if (_configuration.statistics_summary_period().count() > 0) _print_statistics_summary_if_due();
+    if (is_tracing()) _this_thread_trace_buffer()->add_line(text);
+    std::shared_lock<std::shared_mutex> lock(_scheduler_mutex);
+    auto scheduler = _scheduler.load();
+    scheduler->println(_this_thread_data(scheduler), level_increase, std::move(text));
+}
+
+void Logger::println(unsigned int level_increase, std::string_view text) {
+    if (_configuration.statistics_summary_period().count() > 0) _print_statistics_summary_if_due();
+    if (is_tracing()) _this_thread_trace_buffer()->add_line(std::string(text));
+    std::shared_lock<std::shared_mutex> lock(_scheduler_mutex);
+    auto scheduler = _scheduler.load();
+    scheduler->println(_this_thread_data(scheduler), level_increase, text);
+}
+
+void Logger::_println_static(unsigned int level_increase, char const* text) {
+    if (_configuration.statistics_summary_period().count() > 0) _print_statistics_summary_if_due();
+    if (is_tracing()) _this_thread_trace_buffer()->add_line(text);
+    std::shared_lock<std::shared_mutex> lock(_scheduler_mutex);
+    auto scheduler = _scheduler.load();
+    scheduler->println_static(_this_thread_data(scheduler), level_increase, text);
+}
+
+void Logger::_println_deferred(unsigned int level_increase, LogDeferredFormat const& format, std::string&& arguments) {
+    // The trace needs the text right away
+    if (is_tracing()) {
+        write_deferred_text(arguments, format, arguments);
+        println(level_increase, std::move(arguments));
+        return;
+    }
+    if (_configuration.statistics_summary_period().count() > 0) _print_statistics_summary_if_due();
+    std::shared_lock<std::shared_mutex> lock(_scheduler_mutex);
+    auto scheduler = _scheduler.load();
+    scheduler->println_deferred(_this_thread_data(scheduler), level_increase, format, std::move(arguments));
+}
+
+LoggerStatistics Logger::statistics() const {
+    // Both locks are held so that a scheduler being drained is counted exactly once
+    std::shared_lock<std::shared_mutex> lock(_scheduler_mutex);
+    std::lock_guard<std::mutex> retired_lock(_retired_statistics_mutex);
+    LoggerStatistics result = _retired_statistics;
+    if (_draining_scheduler != nullptr) _draining_scheduler->collect_statistics(result);
+    _scheduler_instance->collect_statistics(result);
+    return result;
+}
+
+LoggerStatistics Logger::current_thread_statistics() const {
+    std::shared_lock<std::shared_mutex> lock(_scheduler_mutex);
+    auto& data = _this_thread_data(_scheduler.load());
+    LoggerStatistics result;
+    data.add_statistics(result);
+    result.queue_depth = data.queue_size();
+    return result;
+}
+
+void Logger::_print_statistics_summary_if_due() {
+    auto period = std::chrono::duration_cast<std::chrono::nanoseconds>(_configuration.statistics_summary_period()).count();
+    auto now = steady_clock_ns();
+    auto next = _next_statistics_summary.load();
+    if (next != 0 and now < next) return;
+    // Only the thread claiming the due time prints, which also prevents the recursion from the println below
+    if (not _next_statistics_summary.compare_exchange_strong(next, now + period)) return;
+    // The first period starts from the first print after setting it
+    if (next == 0) return;
+    std::ostringstream ss;
+    ss << statistics();
+    println(0, ss.str());
+}
+
+void Logger::hold(std::string_view scope, std::string const& text) {
+    hold(scope, std::string_view(text));
+}
+
+void Logger::hold(std::string_view scope, std::string&& text) {
+    std::shared_lock<std::shared_mutex> lock(_scheduler_mutex);
+    auto scheduler = _scheduler.load();
+    scheduler->hold(_this_thread_data(scheduler), scope, std::move(text));
+}
+
+void Logger::hold(std::string_view scope, std::string_view text) {
+    std::shared_lock<std::shared_mutex> lock(_scheduler_mutex);
+    auto scheduler = _scheduler.load();
+    scheduler->hold(_this_thread_data(scheduler), scope, text);
+}
+
+void Logger::release(std::string_view scope) {
+    std::shared_lock<std::shared_mutex> lock(_scheduler_mutex);
+    auto scheduler = _scheduler.load();
+    scheduler->release(_this_thread_data(scheduler), scope);
+}
+
+void Logger::flush() {
+    flush_async().get();
+    if (is_tracing()) _write_trace_events();
+}
+
+std::future<void> Logger::flush_async() {
+    std::shared_lock<std::shared_mutex> lock(_scheduler_mutex);
+    return _scheduler.load()->flush();
+}
+
+FlightRecorderRing& Logger::_this_thread_flight_recorder_ring() {
+    if (this_thread_flight_recorder_ring == nullptr) {
+        this_thread_flight_recorder_ring = std::make_shared<FlightRecorderRing>(current_thread_name(),_configuration.recorder_capacity());
+        std::lock_guard<std::mutex> lock(_flight_recorder_mutex);
+        _flight_recorder_rings.push_back(this_thread_flight_recorder_ring);
+    }
+    return *this_thread_flight_recorder_ring;
+}
+
+void Logger::record(unsigned int level_increase, std::string&& text) {
+    _this_thread_flight_recorder_ring().record(current_level()+level_increase,text);
+}
+
+void Logger::record(unsigned int level_increase, std::string_view text) {
+    _this_thread_flight_recorder_ring().record(current_level()+level_increase,text);
+}
+
+void Logger::dump_flight_recorder() {
+    std::vector<LogRawMessage> messages;
+    {
+        std::lock_guard<std::mutex> lock(_flight_recorder_mutex);
+        for (auto const& ring : _flight_recorder_rings) ring->extract(messages);
+        // Rings not referenced by their thread anymore have nothing left to record
+        _flight_recorder_rings.erase(std::remove_if(_flight_recorder_rings.begin(),_flight_recorder_rings.end(),
+                                                    [](auto const& ring) { return ring.use_count() == 1; }),_flight_recorder_rings.end());
+    }
+    std::stable_sort(messages.begin(),messages.end(),[](auto const& m1, auto const& m2) { return m1.timestamp < m2.timestamp; });
+    std::ostringstream ss;
+    for (auto const& msg : messages)
+        ss << msg.identifier << "@" << msg.level << "|" << std::string(msg.level,' ') << msg.text << '\n';
+    std::clog << ss.str() << std::flush;
+}
+
+//! \brief The times of a scope merged from the call trees of all threads
+struct MergedScopeProfile {
+    uint64_t calls = 0;
+    uint64_t total_ns = 0;
+    uint64_t min_ns = std::numeric_limits<uint64_t>::max();
+    uint64_t max_ns = 0;
+    uint64_t histogram[ScopeProfileNode::NUM_HISTOGRAM_BUCKETS] = {};
+    std::map<std::string,MergedScopeProfile> children;
+
+    void merge(ScopeProfileNode const& node) {
+        calls += node.calls.load(std::memory_order_relaxed);
+        total_ns += node.total_ns.load(std::memory_order_relaxed);
+        min_ns = std::min(min_ns,node.min_ns.load(std::memory_order_relaxed));
+        max_ns = std::max(max_ns,node.max_ns.load(std::memory_order_relaxed));
+        for (SizeType i=0; i<ScopeProfileNode::NUM_HISTOGRAM_BUCKETS; ++i) histogram[i] += node.histogram[i].load(std::memory_order_relaxed);
+        for (auto child = node.first_child.load(std::memory_order_acquire); child != nullptr; child = child->next_sibling)
+            children[child->scope].merge(*child);
+    }
+
+    void print(std::ostringstream& ss, std::string const& scope, SizeType depth) const {
+        uint64_t children_ns = 0;
+        for (auto const& child : children) children_ns += child.second.total_ns;
+        ss << std::setw(10) << calls << std::setw(14) << total_ns/1000.0 << std::setw(14) << (total_ns > children_ns ? total_ns-children_ns : 0)/1000.0
+           << std::setw(12) << (calls > 0 ? min_ns : 0)/1000.0 << std::setw(12) << max_ns/1000.0 << "  " << std::string(2*depth,' ') << scope << " |";
+        for (SizeType i=0; i<ScopeProfileNode::NUM_HISTOGRAM_BUCKETS; ++i)
+            if (histogram[i] > 0) ss << " " << i << ":" << histogram[i];
+        ss << '\n';
+        print_children(ss,depth+1);
+    }
+
+    //! \brief Print the children, the most expensive first
+    void print_children(std::ostringstream& ss, SizeType depth) const {
+        std::vector<std::pair<std::string,MergedScopeProfile const*>> sorted;
+        for (auto const& child : children) sorted.push_back({child.first,&child.second});
+        std::stable_sort(sorted.begin(),sorted.end(),[](auto const& c1, auto const& c2) { return c1.second->total_ns > c2.second->total_ns; });
+        for (auto const& child : sorted) child.second->print(ss,child.first,depth);
+    }
+};
+
+std::string Logger::profile_report() const {
+    MergedScopeProfile merged;
+    {
+        std::lock_guard<std::mutex> lock(_profile_mutex);
+        for (auto const& root : _profile_roots) merged.merge(*root);
+    }
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(3);
+    ss << std::setw(10) << "calls" << std::setw(14) << "total(us)" << std::setw(14) << "self(us)" << std::setw(12) << "min(us)"
+       << std::setw(12) << "max(us)" << "  scope | log2(ns):calls\n";
+    merged.print_children(ss,0);
+    return ss.str();
+}
+
+void Logger::_record_latency(LogRawMessage const& msg) {
+    // Measured on the steady clock, since the system clock may be adjusted while the message is enqueued
+    auto ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-msg.steady_timestamp).count());
+    auto kind = _writing_scheduler().kind();
+    std::lock_guard<std::mutex> lock(_latency_mutex);
+    auto& scheduler_latencies = _scheduler_latencies[kind];
+    if (scheduler_latencies == nullptr) scheduler_latencies = std::make_shared<LatencyHistogram>();
+    scheduler_latencies->add(ns);
+    auto& thread_latencies = _thread_latencies[msg.identifier];
+    if (thread_latencies == nullptr) thread_latencies = std::make_shared<LatencyHistogram>();
+    thread_latencies->add(ns);
+}
+
+std::string Logger::latency_report() const {
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(3);
+    ss << std::setw(10) << "lines" << std::setw(12) << "p50(us)" << std::setw(12) << "p99(us)" << std::setw(12) << "p999(us)"
+       << std::setw(12) << "max(us)" << "  source\n";
+    auto print = [&ss](LatencyHistogram const& h, std::string const& source) {
+        ss << std::setw(10) << h.count() << std::setw(12) << h.percentile(0.5)/1000.0 << std::setw(12) << h.percentile(0.99)/1000.0
+           << std::setw(12) << h.percentile(0.999)/1000.0 << std::setw(12) << h.max()/1000.0 << "  " << source << '\n';
+    };
+    std::lock_guard<std::mutex> lock(_latency_mutex);
+    for (auto const& entry : _scheduler_latencies)
+        print(*entry.second,"scheduler (" + entry.first + ")");
+    for (auto const& entry : _thread_latencies)
+        print(*entry.second,"thread " + (entry.first.empty() ? std::string("(unnamed)") : entry.first));
+    return ss.str();
+}
+
+void Logger::trace_to_file(const char* filename) {
+    stop_tracing();
+    std::lock_guard<std::mutex> lock(_trace_mutex);
+    _trace_file.open(filename);
+    _trace_file << "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"conclog\"}}";
+    _trace_start = std::chrono::steady_clock::now();
+    ++_trace_session;
+    _num_traced_threads = 0;
+    _is_tracing = true;
 }
 
-void Logger::hold(std::string scope, std::string text) {
-    _scheduler->hold(scope, text);
+void Logger::stop_tracing() {
+    if (not _is_tracing.exchange(false)) return;
+    _write_trace_events();
+    std::lock_guard<std::mutex> lock(_trace_mutex);
+    _trace_file << "\n]\n";
+    _trace_file.close();
+    _trace_buffers.clear();
 }
 
-void Logger::release(std::string scope) {
-    _scheduler->release(scope);
+bool Logger::is_tracing() const {
+    return _is_tracing.load(std::memory_order_relaxed);
+}
+
+void Logger::trace_counter(std::string const& name, double value) {
+    _this_thread_trace_buffer()->add('C',name,value);
+}
+
+SharedPointer<TraceEventBuffer> const& Logger::_this_thread_trace_buffer() {
+    if (this_thread_trace_buffer == nullptr or this_thread_trace_buffer->session() != _trace_session) {
+        auto name = current_thread_name();
+        std::lock_guard<std::mutex> lock(_trace_mutex);
+        this_thread_trace_buffer = std::make_shared<TraceEventBuffer>(name,_trace_session,++_num_traced_threads);
+        _trace_buffers.push_back(this_thread_trace_buffer);
+    }
+    return this_thread_trace_buffer;
+}
+
+void Logger::_write_trace_events() {
+    std::lock_guard<std::mutex> lock(_trace_mutex);
+    if (not _trace_file.is_open()) return;
+    std::string out;
+    for (auto const& buffer : _trace_buffers) buffer->write(out,_trace_start);
+    _trace_file.write(out.data(),static_cast<std::streamsize>(out.size()));
+    _trace_file.flush();
+    // Buffers not referenced by their thread anymore have nothing left to write
+    _trace_buffers.erase(std::remove_if(_trace_buffers.begin(),_trace_buffers.end(),
+                                        [](auto const& buffer) { return buffer.use_count() == 1; }),_trace_buffers.end());
+}
+
+void Logger::install_fatal_signal_handlers() {
+#ifndef _WIN32
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = &Logger::_handle_fatal_signal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = static_cast<int>(SA_RESETHAND);
+    for (int signal_number : { SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL })
+        sigaction(signal_number, &action, nullptr);
+#endif
+}
+
+void Logger::_handle_fatal_signal(int signal_number) {
+#ifndef _WIN32
+    static volatile std::sig_atomic_t handling = 0;
+    if (handling == 0) {
+        handling = 1;
+        auto& logger = Logger::instance();
+        int fd = STDERR_FILENO;
+        if (not logger._redirect_filename.empty()) {
+            int file_fd = ::open(logger._redirect_filename.c_str(), O_WRONLY | O_APPEND);
+            if (file_fd >= 0) fd = file_fd;
+        }
+        // Any held line is left unterminated
+        emergency_write(fd, "\n", 1);
+        emergency_write_message(fd, "conclog", 0, "emergency flush of pending messages on fatal signal");
+        logger._scheduler.load()->emergency_flush(fd);
+        emergency_write_message(fd, "conclog", 0, "emergency flush of flight recorder lines");
+        for (auto const& ring : logger._flight_recorder_rings) ring->emergency_write(fd);
+        if (fd != STDERR_FILENO) ::close(fd);
+    }
+    // The handler has been reset to the default action, which is taken as soon as this handler returns
+    raise(signal_number);
+#else
+    (void)signal_number;
+#endif
 }
 
 bool Logger::_is_holding() const {
     return !_current_held_stack.empty();
 }
 
-bool Logger::_can_print_thread_name() const {
-    auto sch = dynamic_cast<ImmediateLoggerScheduler*>(_scheduler.get());
+bool Logger::_can_print_thread_name(LoggerConfigurationSnapshot const& configuration) const {
+    auto sch = dynamic_cast<ImmediateLoggerScheduler*>(_scheduler.load());
     // Only if we don't use an immediate scheduler and we have the right printing policy
-    if (sch == nullptr and _configuration.thread_name_printing_policy() != ThreadNamePrintingPolicy::NEVER)
+    if (sch == nullptr and configuration.thread_name_printing_policy != ThreadNamePrintingPolicy::NEVER)
         return true;
     else return false;
 }
@@ -819,90 +2906,35 @@ unsigned int Logger::get_window_columns() const {
     #endif
 }
 
-std::string Logger::_apply_theme(std::string const& text) const {
-    auto theme = _configuration.theme();
-    if (theme.has_style()) {
-        std::ostringstream ss;
+std::string Logger::_apply_theme(LoggerConfigurationSnapshot const& configuration, std::string const& text) const {
+    auto const& codes = configuration.theme_codes;
+    if (codes.has_style) {
+        std::string result;
+        result.reserve(text.size()*2);
         for(auto it = text.begin(); it != text.end(); ++it) {
             const char& c = *it;
-            switch (c) {
-                case '=':
-                case '>':
-                case '<':
-                case '!':
-                    ss << theme.assignment_comparison() << c << TerminalTextStyle::RESET;
-                    break;
-                case '(':
-                case ')':
-                    ss << theme.round_parentheses() << c << TerminalTextStyle::RESET;
-                    break;
-                case '[':
-                case ']':
-                    ss << theme.square_parentheses() << c << TerminalTextStyle::RESET;
-                    break;
-                case '{':
-                case '}':
-                    ss << theme.curly_parentheses() << c << TerminalTextStyle::RESET;
-                    break;
-                case ':':
-                    ss << theme.colon() << c << TerminalTextStyle::RESET;
-                    break;
-                case ',':
-                    ss << theme.comma() << c << TerminalTextStyle::RESET;
-                    break;
-                case '@':
-                    ss << theme.at() << c << TerminalTextStyle::RESET;
-                    break;
-                case '.':
-                    if (it != text.begin() and isdigit(*(it-1)))
-                        ss << theme.number() << c << TerminalTextStyle::RESET;
-                    else
-                        ss << c;
-                    break;
-                case '0':
-                case '1':
-                case '2':
-                case '3':
-                case '4':
-                case '5':
-                case '6':
-                case '7':
-                case '8':
-                case '9':
-                {
-                    // Exclude strings that end with a number (supported up to 2 digits) to account for numbered variables
-                    // For simplicity, this does not work across multiple lines
-                    bool styled = true;
-                    if (it != text.begin()) {
-                        if (isalpha(*(it - 1)))
-                            styled = false;
-                        else if (isdigit(*(it - 1))) {
-                            if ((it - 1) != text.begin()) {
-                                if (isalpha(*(it - 2)))
-                                    styled = false;
-                            }
+            bool styled = true;
+            if (c == '.') {
+                styled = (it != text.begin() and isdigit(*(it-1)));
+            } else if (isdigit(c)) {
+                // Exclude strings that end with a number (supported up to 2 digits) to account for numbered variables
+                // For simplicity, this does not work across multiple lines
+                if (it != text.begin()) {
+                    if (isalpha(*(it - 1)))
+                        styled = false;
+                    else if (isdigit(*(it - 1))) {
+                        if ((it - 1) != text.begin()) {
+                            if (isalpha(*(it - 2)))
+                                styled = false;
                         }
                     }
-                    if (styled) ss << theme.number() << c << TerminalTextStyle::RESET;
-                    else ss << c;
-                    break;
                 }
-                case '+':
-                case '-':
-                case '*':
-                case '/':
-                case '\\':
-                case '^':
-                case '|':
-                case '&':
-                case '%':
-                    ss << theme.miscellaneous_operator() << c << TerminalTextStyle::RESET;
-                    break;
-                default:
-                    ss << c;
             }
+            auto const& styled_text = codes.characters[static_cast<unsigned char>(c)];
+            if (styled and not styled_text.empty()) result += styled_text;
+            else result += c;
         }
-        return _apply_theme_for_keywords(ss.str());
+        return _apply_theme_for_keywords(configuration,result);
     } else return text;
 }
 
@@ -920,16 +2952,9 @@ bool isalphanumeric_withstylecodes(std::string text, size_t pos) {
     } else return true;
 }
 
-std::string Logger::_apply_theme_for_keywords(std::string const& text) const {
+std::string Logger::_apply_theme_for_keywords(LoggerConfigurationSnapshot const& configuration, std::string const& text) const {
     std::string result = text;
-    std::map<std::string,TerminalTextStyle> keyword_styles = {{"virtual",_configuration.theme().keyword},
-                                                              {"const",_configuration.theme().keyword},
-                                                              {"true",_configuration.theme().keyword},
-                                                              {"false",_configuration.theme().keyword},
-                                                              {"inf",_configuration.theme().keyword}};
-    keyword_styles.insert(_configuration.custom_keywords().begin(),_configuration.custom_keywords().end());
-
-    for (auto kws : keyword_styles) {
+    for (auto const& kws : configuration.keyword_styles) {
         std::ostringstream current_result;
         size_t kw_length = kws.first.length();
         size_t kw_pos = std::string::npos;
@@ -940,7 +2965,7 @@ std::string Logger::_apply_theme_for_keywords(std::string const& text) const {
                 (kw_pos+kw_length < result.length() and (isalpha(result.at(kw_pos+kw_length)) or isdigit(result.at(kw_pos+kw_length)))))
                 current_result << result.substr(scan_pos,kw_pos-scan_pos+kw_length);
             else
-                current_result << result.substr(scan_pos,kw_pos-scan_pos) << kws.second() << result.substr(kw_pos,kw_length) << TerminalTextStyle::RESET;
+                current_result << result.substr(scan_pos,kw_pos-scan_pos) << kws.second << result.substr(kw_pos,kw_length) << TerminalTextStyle::RESET;
 
             scan_pos = kw_pos+kw_length;
         }
@@ -952,52 +2977,61 @@ std::string Logger::_apply_theme_for_keywords(std::string const& text) const {
     return result;
 }
 
-void Logger::_print_preamble_for_firstline(unsigned int level, std::string thread_name) {
-    auto theme = _configuration.theme();
-    bool can_print_thread_name = _can_print_thread_name();
+//! \brief Print \a n spaces to the log output, without building a string
+void print_spaces(SizeType n) {
+    static const std::string SPACES(256,' ');
+    for (; n > SPACES.size(); n -= SPACES.size()) std::clog.write(SPACES.data(),static_cast<std::streamsize>(SPACES.size()));
+    std::clog.write(SPACES.data(),static_cast<std::streamsize>(n));
+}
+
+void Logger::_print_preamble_for_firstline(LoggerConfigurationSnapshot const& configuration, unsigned int level, std::string const& thread_name) {
+    auto const& theme = configuration.theme;
+    auto const& codes = configuration.theme_codes;
+    bool can_print_thread_name = _can_print_thread_name(configuration);
     bool thread_name_changed = (_cached_last_printed_thread_name != thread_name);
     bool level_changed = (_cached_last_printed_level != level);
-    bool always_print_level = not(_configuration.prints_level_on_change_only());
-    auto largest_thread_name_size = _scheduler->largest_thread_name_size();
-    std::string thread_name_prefix = std::string(largest_thread_name_size-thread_name.size(),' ');
+    bool always_print_level = not(configuration.prints_level_on_change_only);
+    auto largest_thread_name_size = (can_print_thread_name ? _writing_scheduler().largest_thread_name_size() : 0);
 
-    if (can_print_thread_name and _configuration.thread_name_printing_policy() == ThreadNamePrintingPolicy::BEFORE) {
+    if (can_print_thread_name and configuration.thread_name_printing_policy == ThreadNamePrintingPolicy::BEFORE) {
         if (thread_name_changed) {
-            if (theme.at.is_styled()) std::clog << thread_name_prefix << thread_name << theme.at() << "@" << TerminalTextStyle::RESET;
-            else std::clog << thread_name_prefix << thread_name << "@";
-        } else std::clog << std::string(largest_thread_name_size+1, ' ');
+            print_spaces(largest_thread_name_size-thread_name.size());
+            if (theme.at.is_styled()) std::clog << thread_name << codes.at << "@" << TerminalTextStyle::RESET;
+            else std::clog << thread_name << "@";
+        } else print_spaces(largest_thread_name_size+1);
     }
 
     if ((can_print_thread_name and thread_name_changed) or always_print_level or level_changed) {
-        if (theme.level_number.is_styled()) std::clog << theme.level_number() << level << TerminalTextStyle::RESET;
+        if (theme.level_number.is_styled()) std::clog << codes.level_number << level << TerminalTextStyle::RESET;
         else std::clog << level;
     } else std::clog << (level>9 ? "  " : " ");
 
-    if (can_print_thread_name and _configuration.thread_name_printing_policy() == ThreadNamePrintingPolicy::AFTER) {
+    if (can_print_thread_name and configuration.thread_name_printing_policy == ThreadNamePrintingPolicy::AFTER) {
         if (thread_name_changed) {
-            if (theme.at.is_styled()) std::clog << theme.at() << "@" << TerminalTextStyle::RESET << thread_name;
+            if (theme.at.is_styled()) std::clog << codes.at << "@" << TerminalTextStyle::RESET << thread_name;
             else std::clog << "@" << thread_name;
-        } else std::clog << std::string(largest_thread_name_size+1, ' ');
+        } else print_spaces(largest_thread_name_size+1);
     }
 
-    if (not level_changed and _configuration.prints_level_on_change_only() and theme.level_hidden_separator.is_styled()) {
-        std::clog << theme.level_hidden_separator() << "|" << TerminalTextStyle::RESET;
-    } else if ((level_changed and theme.level_shown_separator.is_styled()) or not _configuration.prints_level_on_change_only()) {
-        std::clog << theme.level_shown_separator() << "|" << TerminalTextStyle::RESET;
+    if (not level_changed and configuration.prints_level_on_change_only and theme.level_hidden_separator.is_styled()) {
+        std::clog << codes.level_hidden_separator << "|" << TerminalTextStyle::RESET;
+    } else if ((level_changed and theme.level_shown_separator.is_styled()) or not configuration.prints_level_on_change_only) {
+        std::clog << codes.level_shown_separator << "|" << TerminalTextStyle::RESET;
     } else {
         std::clog << "|";
     }
-    if (_configuration.indents_based_on_level()) std::clog << std::string(level, ' ');
+    if (configuration.indents_based_on_level) print_spaces(level);
 }
 
-void Logger::_print_preamble_for_extralines(unsigned int level) {
-    auto theme = _configuration.theme();
+void Logger::_print_preamble_for_extralines(LoggerConfigurationSnapshot const& configuration, unsigned int level) {
+    auto const& theme = configuration.theme;
+    auto const& codes = configuration.theme_codes;
     std::clog << (level>9 ? "  " : " ");
-    if (_can_print_thread_name()) std::clog << std::string(_scheduler->largest_thread_name_size() + 1, ' ');
-    if (theme.multiline_separator.is_styled()) std::clog << theme.multiline_separator() << "·" << TerminalTextStyle::RESET;
+    if (_can_print_thread_name(configuration)) print_spaces(_writing_scheduler().largest_thread_name_size() + 1);
+    if (theme.multiline_separator.is_styled()) std::clog << codes.multiline_separator << "·" << TerminalTextStyle::RESET;
     else std::clog << "·";
 
-    if (_configuration.indents_based_on_level()) std::clog << std::string(level, ' ');
+    if (configuration.indents_based_on_level) print_spaces(level);
 }
 
 std::string Logger::_discard_newlines_and_indentation(std::string const& text) {
@@ -1021,8 +3055,8 @@ std::string Logger::_discard_newlines_and_indentation(std::string const& text) {
     return result.str();
 }
 
-void Logger::_print_held_line() {
-    auto theme = _configuration.theme();
+void Logger::_print_held_line(LoggerConfigurationSnapshot const& configuration) {
+    auto const& codes = configuration.theme_codes;
     const unsigned int max_columns = get_window_columns();
     unsigned int held_columns = 0;
 
@@ -1030,19 +3064,19 @@ void Logger::_print_held_line() {
     for (auto msg : _current_held_stack) {
         held_columns = held_columns+(msg.level>9 ? 2 : 1)+3+static_cast<unsigned int>(msg.text.size());
         if (held_columns>max_columns+1) {
-            std::string original = theme.level_number() + std::to_string(msg.level) + TerminalTextStyle::RESET +
-                                   theme.level_shown_separator() + "|" + TerminalTextStyle::RESET + " " + _apply_theme(msg.text) + " ";
+            std::string original = codes.level_number + std::to_string(msg.level) + TerminalTextStyle::RESET +
+                                   codes.level_shown_separator + "|" + TerminalTextStyle::RESET + " " + _apply_theme(configuration,msg.text) + " ";
             std::clog << original.substr(0,original.size()-(held_columns-max_columns+2)) << "..";
             held_columns=max_columns;
             break;
         } else if(held_columns==max_columns || held_columns==max_columns+1) {
-            std::clog << theme.level_number() << msg.level << TerminalTextStyle::RESET <<
-                         theme.level_shown_separator() << "|" << TerminalTextStyle::RESET << " " << _apply_theme(msg.text);
+            std::clog << codes.level_number << msg.level << TerminalTextStyle::RESET <<
+                         codes.level_shown_separator << "|" << TerminalTextStyle::RESET << " " << _apply_theme(configuration,msg.text);
             held_columns=max_columns;
             break;
         } else {
-            std::clog << theme.level_number() << msg.level << TerminalTextStyle::RESET <<
-                         theme.level_shown_separator() << "|" << TerminalTextStyle::RESET << " " << _apply_theme(msg.text) << " ";
+            std::clog << codes.level_number << msg.level << TerminalTextStyle::RESET <<
+                         codes.level_shown_separator << "|" << TerminalTextStyle::RESET << " " << _apply_theme(configuration,msg.text) << " ";
         }
     }
     std::clog << std::flush;
@@ -1052,86 +3086,85 @@ void Logger::_print_held_line() {
     std::this_thread::sleep_for(std::chrono::microseconds(10<<_cached_last_printed_level));
 }
 
+void Logger::_print_with_theme(LoggerConfigurationSnapshot const& configuration, std::string const& text, SizeType pos, SizeType count) const {
+    if (configuration.theme_codes.has_style) std::clog << _apply_theme(configuration,text.substr(pos,count));
+    else std::clog.write(text.data()+pos,static_cast<std::streamsize>(count));
+}
+
 void Logger::_cover_held_columns_with_whitespaces(unsigned int printed_columns) {
     if (_is_holding()) {
         if (_cached_num_held_columns > printed_columns)
-            std::clog << std::string(_cached_num_held_columns - printed_columns, ' ');
+            print_spaces(_cached_num_held_columns - printed_columns);
     }
 }
 
 void Logger::_println(LogRawMessage const& msg) {
-    const unsigned int preamble_columns = (msg.level>9 ? 3:2)+(_can_print_thread_name() ? static_cast<unsigned int>(_scheduler->largest_thread_name_size()+1) : 0)+msg.level;
+    std::lock_guard<std::mutex> output_lock(_output_mutex);
+    // Held for the whole print, since reading the configuration again may release the snapshot cached by the thread
+    auto const snapshot = _configuration.snapshot();
+    auto const& configuration = *snapshot;
+    if (configuration.output_format == LogOutputFormat::NDJSON) {
+        _print_ndjson(msg);
+        if (configuration.traces_latency) _record_latency(msg);
+        return;
+    }
+    const unsigned int preamble_columns = (msg.level>9 ? 3:2)+(_can_print_thread_name(configuration) ? static_cast<unsigned int>(_writing_scheduler().largest_thread_name_size()+1) : 0)+msg.level;
     // If holding, we must write over the held line first
     if (_is_holding()) std::clog << '\r';
 
-    _print_preamble_for_firstline(msg.level,msg.identifier);
-    std::string text = msg.text;
-    if (configuration().discards_newlines_and_indentation()) text = _discard_newlines_and_indentation(text);
-    if (configuration().handles_multiline_output() and msg.text.size() > 0) {
+    _print_preamble_for_firstline(configuration,msg.level,msg.identifier);
+    std::string discarded_text;
+    if (configuration.discards_newlines_and_indentation) discarded_text = _discard_newlines_and_indentation(msg.text);
+    std::string const& text = (configuration.discards_newlines_and_indentation ? discarded_text : msg.text);
+    if (configuration.handles_multiline_output and msg.text.size() > 0) {
         const unsigned int max_columns = get_window_columns();
         size_t text_ptr = 0;
         const size_t text_size = text.size();
         while(true) {
-            if (text_size-text_ptr + preamble_columns > max_columns) { // (remaining) Text too long for a single terminal line
-                std::string to_print = text.substr(text_ptr,max_columns-preamble_columns);
-                std::size_t newline_pos = to_print.find('\n');
-                if (newline_pos != std::string::npos) { // A newline is found before reaching the end of the terminal line
-                    std::clog << _apply_theme(to_print.substr(0,newline_pos));
-                    _cover_held_columns_with_whitespaces(preamble_columns+static_cast<unsigned int>(to_print.substr(0,newline_pos).size()));
-                    text_ptr += newline_pos+1;
-                } else { // Text reaches the end of the terminal line
-                    std::clog << _apply_theme(to_print);
-                    _cover_held_columns_with_whitespaces(preamble_columns+static_cast<unsigned int>(to_print.size()));
-                    text_ptr += max_columns-preamble_columns;
-                }
-                std::clog << '\n';
-                if (_is_holding()) _print_held_line();
-                if (_is_holding()) std::clog << '\r';
-
-                _print_preamble_for_extralines(msg.level);
-            } else { // (remaining) Text shorter than the terminal line
-                std::string to_print = text.substr(text_ptr,text_size-text_ptr);
-                std::size_t newline_pos = to_print.find('\n');
-                if (newline_pos != std::string::npos) { // A newline is found before reaching the end of the terminal line
-                    std::clog << _apply_theme(to_print.substr(0,newline_pos));
-                    _cover_held_columns_with_whitespaces(preamble_columns+static_cast<unsigned int>(to_print.substr(0,newline_pos).size()));
-                    std::clog << '\n';
-                    if (_is_holding()) {
-                        _print_held_line();
-                        std::clog << '\r';
-                    }
-
-                    text_ptr += newline_pos+1;
-                    _print_preamble_for_extralines(msg.level);
-                } else { // Text reaches the end of the terminal line
-                    std::clog << _apply_theme(to_print);
-                    _cover_held_columns_with_whitespaces(preamble_columns+static_cast<unsigned int>(to_print.size()));
-                    std::clog << '\n';
-                    if (_is_holding()) _print_held_line();
-
-                    break;
-                }
-            }
+            // If the (remaining) text is too long for a single terminal line, it is split at the end of the terminal line
+            const bool too_long = text_size-text_ptr + preamble_columns > max_columns;
+            const size_t line_size = (too_long ? max_columns-preamble_columns : text_size-text_ptr);
+            const size_t newline_pos = text.find('\n',text_ptr);
+            // A newline is found before reaching the end of the terminal line
+            const bool has_newline = (newline_pos != std::string::npos and newline_pos < text_ptr+line_size);
+            const size_t printed_size = (has_newline ? newline_pos-text_ptr : line_size);
+            _print_with_theme(configuration,text,text_ptr,printed_size);
+            _cover_held_columns_with_whitespaces(preamble_columns+static_cast<unsigned int>(printed_size));
+            std::clog << '\n';
+            if (_is_holding()) _print_held_line(configuration);
+            if (not too_long and not has_newline) break;
+            if (_is_holding()) std::clog << '\r';
+            text_ptr += (has_newline ? printed_size+1 : line_size);
+            _print_preamble_for_extralines(configuration,msg.level);
         }
     } else { // No multiline is handled, \n characters are handled by the terminal
-        std::clog << _apply_theme(text);
+        _print_with_theme(configuration,text,0,text.size());
         _cover_held_columns_with_whitespaces(preamble_columns+static_cast<unsigned int>(text.size()));
         std::clog << '\n';
-        if (_is_holding()) _print_held_line();
+        if (_is_holding()) _print_held_line(configuration);
     }
     _cached_last_printed_level = msg.level;
     _cached_last_printed_thread_name = msg.identifier;
+    if (configuration.traces_latency) _record_latency(msg);
 }
 
 void Logger::_hold(LogRawMessage const& msg) {
+    std::lock_guard<std::mutex> output_lock(_output_mutex);
+    auto const snapshot = _configuration.snapshot();
+    auto const& configuration = *snapshot;
+    if (configuration.output_format == LogOutputFormat::NDJSON) { _print_ndjson(msg); return; }
     bool scope_found = false;
     for (unsigned int idx=0; idx<_current_held_stack.size(); ++idx) {
         if (_current_held_stack[idx].scope == msg.scope) { _current_held_stack[idx] = msg; scope_found = true; break; } }
     if (not scope_found) { _current_held_stack.push_back(msg); }
-    _print_held_line();
+    _print_held_line(configuration);
 }
 
 void Logger::_release(LogRawMessage const& msg) {
+    std::lock_guard<std::mutex> output_lock(_output_mutex);
+    auto const snapshot = _configuration.snapshot();
+    auto const& configuration = *snapshot;
+    if (configuration.output_format == LogOutputFormat::NDJSON) { _print_ndjson(msg); return; }
     if (_is_holding()) {
         bool found = false;
         unsigned int i=0;
@@ -1150,7 +3183,7 @@ void Logger::_release(LogRawMessage const& msg) {
                 }
             }
             _current_held_stack = new_held_stack;
-            _print_held_line(); // Re-print
+            _print_held_line(configuration); // Re-print
             std::clog << std::string(std::min(released_text_length,get_window_columns()), ' '); // Fill the released chars with blanks
             if (not _is_holding()) // If nothing is held anymore, allow overwriting of the line
                 std::clog << '\r';
@@ -1159,6 +3192,122 @@ void Logger::_release(LogRawMessage const& msg) {
     }
 }
 
+// Appends the text as the content of a JSON string; runs that need no escaping are found 8 bytes at a time and copied in bulk
+void append_json_escaped(std::string& out, std::string const& text) {
+    static const char* HEX_DIGITS = "0123456789abcdef";
+    const uint64_t ONES = 0x0101010101010101ULL;
+    const uint64_t HIGHS = 0x8080808080808080ULL;
+    const char* data = text.data();
+    const size_t size = text.size();
+    size_t run_begin = 0;
+    size_t pos = 0;
+    while (pos < size) {
+        if (pos + 8 <= size) {
+            uint64_t word;
+            std::memcpy(&word, data + pos, 8);
+            const uint64_t quotes = word ^ (ONES * '"');
+            const uint64_t backslashes = word ^ (ONES * '\\');
+            const uint64_t special = ((word - ONES * 0x20) & ~word) | ((quotes - ONES) & ~quotes) | ((backslashes - ONES) & ~backslashes);
+            if ((special & HIGHS) == 0) { pos += 8; continue; }
+        }
+        const auto c = static_cast<unsigned char>(data[pos]);
+        if (c == '"' or c == '\\' or c < 0x20) {
+            out.append(data + run_begin, pos - run_begin);
+            switch (c) {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                case '\b': out += "\\b"; break;
+                case '\f': out += "\\f"; break;
+                default:
+                    out += "\\u00";
+                    out += HEX_DIGITS[c >> 4];
+                    out += HEX_DIGITS[c & 0xF];
+            }
+            run_begin = pos + 1;
+        }
+        ++pos;
+    }
+    out.append(data + run_begin, size - run_begin);
+}
+
+void append_json_unsigned(std::string& out, unsigned long long value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, static_cast<size_t>(result.ptr - digits));
+}
+
+void TraceEventBuffer::write(std::string& out, std::chrono::steady_clock::time_point start) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (not _has_written_track_name) {
+        out += ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":";
+        append_json_unsigned(out, _track);
+        out += ",\"args\":{\"name\":\"";
+        append_json_escaped(out, _thread_name);
+        out += "\"}}";
+        _has_written_track_name = true;
+    }
+    for (auto const& event : _events) {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(event.time - start).count();
+        auto ts = static_cast<unsigned long long>(std::max(ns,decltype(ns)(0)));
+        out += ",\n{\"name\":\"";
+        append_json_escaped(out, event.phase == 'i' ? event.text : _names[event.name_index]);
+        out += "\",\"ph\":\"";
+        out += event.phase;
+        out += "\",\"ts\":";
+        append_json_unsigned(out, ts/1000);
+        out += '.';
+        out += static_cast<char>('0' + ts/100%10);
+        out += static_cast<char>('0' + ts/10%10);
+        out += static_cast<char>('0' + ts%10);
+        out += ",\"pid\":1,\"tid\":";
+        append_json_unsigned(out, _track);
+        if (event.phase == 'i') out += ",\"s\":\"t\"";
+        else if (event.phase == 'C') {
+            char value[32];
+            std::snprintf(value, sizeof(value), "%.17g", std::isfinite(event.value) ? event.value : 0.0);
+            out += ",\"args\":{\"value\":";
+            out += value;
+            out += '}';
+        }
+        out += '}';
+    }
+    _events.clear();
+}
+
+// Per thread, since the immediate scheduler prints from the submitting threads concurrently
+thread_local std::string this_thread_ndjson_buffer;
+
+void Logger::_print_ndjson(LogRawMessage const& msg) {
+    std::string& buf = this_thread_ndjson_buffer;
+    buf.clear();
+    buf += "{\"timestamp\":";
+    append_json_unsigned(buf, static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::microseconds>(msg.timestamp.time_since_epoch()).count()));
+    buf += ",\"thread\":\"";
+    // The immediate scheduler does not supply an identifier, but the printing thread is the submitting one
+    append_json_escaped(buf, msg.identifier.empty() ? current_thread_name() : msg.identifier);
+    buf += "\",\"level\":";
+    append_json_unsigned(buf, msg.level);
+    buf += ",\"scope\":\"";
+    append_json_escaped(buf, msg.scope);
+    buf += "\",\"callsite\":";
+    append_json_unsigned(buf, msg.callsite);
+    buf += ",\"kind\":\"";
+    switch (msg.kind()) {
+        default : [[fallthrough]];
+        case RawMessageKind::PRINTLN : buf += "println"; break;
+        case RawMessageKind::HOLD : buf += "hold"; break;
+        case RawMessageKind::RELEASE : buf += "release"; break;
+    }
+    buf += "\",\"text\":\"";
+    append_json_escaped(buf, msg.text);
+    buf += "\"}\n";
+    std::clog.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+    _cached_last_printed_level = msg.level;
+    _cached_last_printed_thread_name = msg.identifier;
+}
 
 } // namespace ConcLog
 
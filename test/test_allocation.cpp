@@ -0,0 +1,184 @@
+/***************************************************************************
+ *            test_allocation.cpp
+ *
+ *  Copyright  2021  Luca Geretti
+ *
+ ****************************************************************************/
+
+/*
+ * This file is part of CONCLOG, under the MIT license.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <streambuf>
+#include <thread>
+#include "logging.hpp"
+#include "test.hpp"
+
+using namespace ConcLog;
+
+// The global allocation functions are replaced to count the allocations from any thread while enabled
+std::atomic<bool> counting_allocations(false);
+std::atomic<unsigned long> num_allocations(0);
+
+void* operator new(std::size_t size) {
+    if (counting_allocations.load()) ++num_allocations;
+    if (void* ptr = std::malloc(size == 0 ? 1 : size)) return ptr;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+// The aligned forms, used for instance by the cache-line aligned queue entries, keep the pointer to free right before the aligned storage
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    if (counting_allocations.load()) ++num_allocations;
+    auto align = static_cast<std::size_t>(alignment);
+    if (void* ptr = std::malloc(size + align + sizeof(void*))) {
+        auto address = (reinterpret_cast<std::uintptr_t>(ptr) + sizeof(void*) + align - 1) & ~(static_cast<std::uintptr_t>(align) - 1);
+        reinterpret_cast<void**>(address)[-1] = ptr;
+        return reinterpret_cast<void*>(address);
+    }
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) { return operator new(size,alignment); }
+void operator delete(void* ptr, std::align_val_t) noexcept { if (ptr != nullptr) std::free(static_cast<void**>(ptr)[-1]); }
+void operator delete[](void* ptr, std::align_val_t alignment) noexcept { operator delete(ptr,alignment); }
+void operator delete(void* ptr, std::size_t, std::align_val_t alignment) noexcept { operator delete(ptr,alignment); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t alignment) noexcept { operator delete(ptr,alignment); }
+
+//! \brief A stream buffer discarding everything, so that the sink does not allocate on its own
+//! \details While closed, writes wait for the buffer to open, to let the queue of the nonblocking scheduler fill up
+class GatedNullStreamBuffer : public std::streambuf {
+  public:
+    GatedNullStreamBuffer() : _open(true) { }
+    void close() { _open = false; }
+    void open() { _open = true; }
+  protected:
+    int_type overflow(int_type c) override { _wait(); return traits_type::not_eof(c); }
+    std::streamsize xsputn(char const*, std::streamsize n) override { _wait(); return n; }
+  private:
+    void _wait() const { while (not _open.load()) std::this_thread::yield(); }
+  private:
+    std::atomic<bool> _open;
+};
+
+class ThreadRegistry : public ThreadRegistryInterface {
+  public:
+    bool has_threads_registered() const override { return false; }
+};
+
+enum class SchedulerKind { IMMEDIATE, BLOCKING, NONBLOCKING };
+
+class TestAllocation {
+  private:
+    static const unsigned int NUM_LINES = 1000;
+    static const unsigned int NUM_WARMUP_ROUNDS = 4;
+    ThreadRegistry _registry;
+  public:
+    TestAllocation() {
+        Logger::instance().attach_thread_registry(&_registry);
+        Logger::instance().configuration().set_prints_level_on_change_only(false);
+        Logger::instance().configuration().set_verbosity(1);
+    }
+
+    void test() {
+        CONCLOG_TEST_CALL(test_steady_state(SchedulerKind::IMMEDIATE,false))
+        CONCLOG_TEST_CALL(test_steady_state(SchedulerKind::BLOCKING,false))
+        CONCLOG_TEST_CALL(test_steady_state(SchedulerKind::NONBLOCKING,false))
+        CONCLOG_TEST_CALL(test_steady_state(SchedulerKind::NONBLOCKING,true))
+        CONCLOG_TEST_CALL(test_recorded_steady_state())
+    }
+
+    void record_steady_lines() {
+        for (unsigned int i=0; i<NUM_LINES; ++i) CONCLOG_PRINTLN_AT(1,"recorded line " << i << " with value " << 1.5*i)
+    }
+
+    //! \brief Record muted lines of bounded size into the flight recorder after a warm-up, checking that no allocation happens
+    void test_recorded_steady_state() {
+        Logger::instance().configuration().set_recorder_verbosity(3);
+        Logger::instance().configuration().set_recorder_capacity(64);
+        // The ring and the call site are created on the first record, then each slot gets a longer text
+        record_steady_lines();
+        for (unsigned int i=0; i<NUM_LINES; ++i) CONCLOG_PRINTLN_AT(1,"warmup recorded line " << i << " with a longer value " << 1.5*i+NUM_LINES)
+
+        num_allocations = 0;
+        counting_allocations = true;
+        record_steady_lines();
+        counting_allocations = false;
+
+        Logger::instance().configuration().set_recorder_verbosity(0);
+        CONCLOG_TEST_EQUALS(num_allocations.load(),0)
+    }
+
+    void print_steady_lines() {
+        for (unsigned int i=0; i<NUM_LINES; ++i) CONCLOG_PRINTLN("steady line " << i << " with value " << 1.5*i)
+    }
+
+    //! \brief Print lines of bounded size after a warm-up, checking that no allocation happens in between
+    //! \details The nonblocking scheduler is waited for without flushing, since the flush itself is not allocation-free
+    void test_steady_state(SchedulerKind scheduler, bool ndjson) {
+        switch(scheduler) {
+            case SchedulerKind::IMMEDIATE : Logger::instance().use_immediate_scheduler(); break;
+            case SchedulerKind::BLOCKING : Logger::instance().use_blocking_scheduler(); break;
+            default : Logger::instance().use_nonblocking_scheduler();
+        }
+        Logger::instance().configuration().set_output_format(ndjson ? LogOutputFormat::NDJSON : LogOutputFormat::TEXT);
+        GatedNullStreamBuffer null_buffer;
+        auto previous_buffer = std::clog.rdbuf(&null_buffer);
+
+        // The call site of the steady lines allocates when registered, on its first call
+        print_steady_lines();
+        // Lines longer than the following ones, with the consumer held back so that the queue reaches the largest depth,
+        // a few times since the slots written shift at each round, so that eventually each one is written at least once
+        for (unsigned int round=0; round<NUM_WARMUP_ROUNDS; ++round) {
+            if (scheduler == SchedulerKind::NONBLOCKING) null_buffer.close();
+            for (unsigned int i=0; i<NUM_LINES; ++i) CONCLOG_PRINTLN("warmup line " << i << " with a longer value " << 1.5*i+NUM_LINES)
+            null_buffer.open();
+            Logger::instance().flush();
+        }
+        auto target = Logger::instance().statistics().messages_written + NUM_LINES;
+
+        num_allocations = 0;
+        counting_allocations = true;
+        print_steady_lines();
+        if (scheduler == SchedulerKind::NONBLOCKING)
+            while (Logger::instance().statistics().messages_written < target) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        counting_allocations = false;
+
+        Logger::instance().flush();
+        std::clog.rdbuf(previous_buffer);
+        Logger::instance().configuration().set_output_format(LogOutputFormat::TEXT);
+        Logger::instance().use_immediate_scheduler();
+        CONCLOG_TEST_EQUALS(num_allocations.load(),0)
+    }
+};
+
+int main() {
+
+    TestAllocation().test();
+
+    return CONCLOG_TEST_FAILURES;
+}
@@ -0,0 +1,106 @@
+/***************************************************************************
+ *            test_coroutine_context.cpp
+ *
+ *  Copyright  2021  Luca Geretti
+ *
+ ****************************************************************************/
+
+/*
+ * This file is part of CONCLOG, under the MIT license.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "logging.hpp"
+#include "coroutine_context.hpp"
+#include "test.hpp"
+
+using namespace ConcLog;
+
+#if __has_include(<coroutine>) and defined(__cpp_impl_coroutine)
+
+//! \brief An awaitable that resumes the coroutine on a new thread
+struct ResumeOnNewThread {
+    std::thread& thread;
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) { thread = std::thread([handle] { handle.resume(); }); }
+    void await_resume() const noexcept { }
+};
+
+//! \brief A coroutine that starts eagerly and is destroyed by its owner
+struct Task {
+    struct promise_type : LogContextPromise {
+        Task get_return_object() { return Task{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+        auto initial_suspend() { return log_context_awaiter(std::suspend_never{}); }
+        auto final_suspend() noexcept { return log_context_awaiter(std::suspend_always{}); }
+        void return_void() { }
+        void unhandled_exception() { std::terminate(); }
+    };
+    Task(std::coroutine_handle<promise_type> h) : handle(h) { }
+    Task(Task const&) = delete;
+    ~Task() { if (handle) handle.destroy(); }
+    std::coroutine_handle<promise_type> handle;
+};
+
+Task switch_thread(std::thread& thread, LogContext& context_after_switch) {
+    CONCLOG_SCOPE_CREATE
+    CONCLOG_PRINTLN("Before switching thread")
+    co_await ResumeOnNewThread{thread};
+    CONCLOG_PRINTLN("After switching thread")
+    context_after_switch = Logger::instance().current_context();
+}
+
+class TestCoroutineContext {
+  public:
+    void test() {
+        CONCLOG_TEST_CALL(test_context_across_threads())
+    }
+
+    void test_context_across_threads() {
+        Logger::instance().configuration().set_verbosity(3);
+        Logger::instance().configuration().set_thread_name_printing_policy(ThreadNamePrintingPolicy::BEFORE);
+        auto main_context = Logger::instance().current_context();
+        LogContext context_after_switch = main_context;
+        std::thread thread;
+        {
+            auto task = switch_thread(thread,context_after_switch);
+            CONCLOG_TEST_EQUALS(Logger::instance().current_level(),main_context.level())
+            CONCLOG_TEST_ASSERT(Logger::instance().current_context().scopes().empty())
+            thread.join();
+        }
+        Logger::instance().flush();
+        CONCLOG_TEST_EQUALS(context_after_switch.level(),main_context.level()+1)
+        CONCLOG_TEST_EQUALS(context_after_switch.thread_name(),main_context.thread_name())
+        CONCLOG_TEST_EQUALS(context_after_switch.scopes().size(),1)
+        Logger::instance().configuration().set_thread_name_printing_policy(ThreadNamePrintingPolicy::NEVER);
+    }
+};
+
+int main() {
+    TestCoroutineContext().test();
+    return CONCLOG_TEST_FAILURES;
+}
+
+#else
+
+int main() {
+    CONCLOG_TEST_NOTIFY("Coroutines are not supported by the compiler")
+    return CONCLOG_TEST_FAILURES;
+}
+
+#endif
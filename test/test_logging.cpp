@@ -26,7 +26,12 @@
  * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <iomanip>
 #include <list>
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 #include "thread.hpp"
 #include "logging.hpp"
 #include "progress_indicator.hpp"
@@ -60,6 +65,25 @@ void print_something1() {
     CONCLOG_PRINTLN("This is a call from thread id " << std::this_thread::get_id() << " named '" << Logger::instance().current_thread_name() << "'")
 }
 
+int print_and_return_value() {
+    CONCLOG_PRINTLN("Nested " << 1.5)
+    return 7;
+}
+
+//! \brief A value whose printing flushes the logger, hence from the consumption thread when deferred
+struct FlushingValue {
+    int value;
+};
+
+std::ostream& operator<<(std::ostream& os, FlushingValue const& v) {
+    Logger::instance().flush();
+    return os << v.value;
+}
+
+void print_reachability_step(unsigned int i) {
+    CONCLOG_PRINTLN_AT(2,"reachability step " << i)
+}
+
 void print_something2() {
     CONCLOG_SCOPE_CREATE
     CONCLOG_PRINTLN("This is a call from thread id " << std::this_thread::get_id() << " named '" << Logger::instance().current_thread_name() << "'")
@@ -104,9 +128,29 @@ class TestLogging {
         CONCLOG_TEST_CALL(test_handles_multiline_output())
         CONCLOG_TEST_CALL(test_discards_newlines_and_indentation())
         CONCLOG_TEST_CALL(test_redirect())
+        CONCLOG_TEST_CALL(test_ndjson_output())
+        CONCLOG_TEST_CALL(test_reused_text_streams())
+        CONCLOG_TEST_CALL(test_text_views())
+        CONCLOG_TEST_CALL(test_queue_slot_text())
+        CONCLOG_TEST_CALL(test_callsites())
+        CONCLOG_TEST_CALL(test_verbosity_filters())
+        CONCLOG_TEST_CALL(test_thread_verbosity())
+        CONCLOG_TEST_CALL(test_deferred_format())
+        CONCLOG_TEST_CALL(test_typed_format())
+        CONCLOG_TEST_CALL(test_flight_recorder())
+        CONCLOG_TEST_CALL(test_emergency_flush_on_fatal_signal())
         CONCLOG_TEST_CALL(test_multiple_threads_with_blocking_scheduler())
         CONCLOG_TEST_CALL(test_multiple_threads_with_nonblocking_scheduler())
+        CONCLOG_TEST_CALL(test_flush())
+        CONCLOG_TEST_CALL(test_scheduler_change_with_registered_threads())
+        CONCLOG_TEST_CALL(test_configuration_snapshots())
         CONCLOG_TEST_CALL(test_register_self_thread())
+        CONCLOG_TEST_CALL(test_automatic_thread_registration())
+        CONCLOG_TEST_CALL(test_context_propagation())
+        CONCLOG_TEST_CALL(test_scope_profiler())
+        CONCLOG_TEST_CALL(test_trace_export())
+        CONCLOG_TEST_CALL(test_statistics())
+        CONCLOG_TEST_CALL(test_latency_report())
         CONCLOG_TEST_CALL(test_printing_policy_with_theme_and_print_level(true,true))
         CONCLOG_TEST_CALL(test_printing_policy_with_theme_and_print_level(true,false))
         CONCLOG_TEST_CALL(test_printing_policy_with_theme_and_print_level(false,false))
@@ -122,9 +166,9 @@ class TestLogging {
         CONCLOG_TEST_EXECUTE(Logger::instance().use_blocking_scheduler())
         CONCLOG_TEST_EXECUTE(Logger::instance().use_nonblocking_scheduler())
         _registry.set_threads_registered(1);
-        CONCLOG_TEST_FAIL(Logger::instance().use_immediate_scheduler())
-        CONCLOG_TEST_FAIL(Logger::instance().use_blocking_scheduler())
-        CONCLOG_TEST_FAIL(Logger::instance().use_nonblocking_scheduler())
+        CONCLOG_TEST_EXECUTE(Logger::instance().use_immediate_scheduler())
+        CONCLOG_TEST_EXECUTE(Logger::instance().use_blocking_scheduler())
+        CONCLOG_TEST_EXECUTE(Logger::instance().use_nonblocking_scheduler())
         _registry.set_threads_registered(0);
     }
 
@@ -359,6 +403,342 @@ class TestLogging {
         CONCLOG_TEST_EQUALS(count,3);
     }
 
+    //! \brief Print in NDJSON format into \a filename by calling \a action, then return the lines printed
+    //! \details Restores the text output on the console with the immediate scheduler, and removes the file
+    template<class F> std::vector<std::string> capture_ndjson(std::string const& filename, F const& action) {
+        Logger::instance().configuration().set_output_format(LogOutputFormat::NDJSON);
+        Logger::instance().redirect_to_file(filename.c_str());
+        action();
+        Logger::instance().flush();
+        Logger::instance().redirect_to_console();
+        Logger::instance().configuration().set_output_format(LogOutputFormat::TEXT);
+        Logger::instance().use_immediate_scheduler();
+
+        std::ifstream file(filename);
+        std::vector<std::string> lines;
+        std::string line;
+        while (getline(file,line)) lines.push_back(line);
+        file.close();
+        std::remove(filename.c_str());
+        return lines;
+    }
+
+    void test_ndjson_output() {
+        Logger::instance().use_immediate_scheduler();
+        Logger::instance().configuration().set_verbosity(1);
+        auto lines = capture_ndjson("log.ndjson",[] {
+            CONCLOG_PRINTLN("A \"quoted\" text with a \\ backslash,\ta tab and\na newline")
+            CONCLOG_PRINTLN("A plain text long enough to go through the fast path")
+        });
+        CONCLOG_TEST_EQUALS(lines.size(),2)
+        if (lines.size() != 2) return;
+        CONCLOG_TEST_PRINT(lines[0])
+        CONCLOG_TEST_PRINT(lines[1])
+        CONCLOG_TEST_ASSERT(lines[0].find("\"level\":1,\"scope\":\"\",\"callsite\":") != std::string::npos)
+        CONCLOG_TEST_ASSERT(lines[0].find(",\"kind\":\"println\"") != std::string::npos)
+        CONCLOG_TEST_ASSERT(lines[0].find("\"text\":\"A \\\"quoted\\\" text with a \\\\ backslash,\\ta tab and\\na newline\"}") != std::string::npos)
+        CONCLOG_TEST_ASSERT(lines[1].find("\"text\":\"A plain text long enough to go through the fast path\"}") != std::string::npos)
+    }
+
+    void test_reused_text_streams() {
+        Logger::instance().use_nonblocking_scheduler();
+        Logger::instance().configuration().set_verbosity(1);
+        auto lines = capture_ndjson("log_streams.ndjson",[] {
+            CONCLOG_PRINTLN(std::hex << 255 << " " << std::setprecision(2) << 1.2345 << " " << std::setw(4) << std::setfill('0') << 7)
+            CONCLOG_PRINTLN(255 << " " << 1.2345 << " " << std::setw(4) << 7 << " " << true)
+            CONCLOG_PRINTLN("Outer " << print_and_return_value() << " end")
+            CONCLOG_PRINTLN(std::string(1000,'x'))
+            CONCLOG_PRINTLN("Short")
+        });
+        CONCLOG_TEST_EQUALS(lines.size(),6)
+        if (lines.size() != 6) return;
+        CONCLOG_TEST_ASSERT(lines[0].find("\"text\":\"ff 1.2 0007\"}") != std::string::npos)
+        CONCLOG_TEST_ASSERT(lines[1].find("\"text\":\"255 1.2345    7 true\"}") != std::string::npos)
+        CONCLOG_TEST_ASSERT(lines[2].find("\"text\":\"Nested 1.5\"}") != std::string::npos)
+        CONCLOG_TEST_ASSERT(lines[3].find("\"text\":\"Outer 7 end\"}") != std::string::npos)
+        CONCLOG_TEST_ASSERT(lines[4].find("\"text\":\"" + std::string(1000,'x') + "\"}") != std::string::npos)
+        CONCLOG_TEST_ASSERT(lines[5].find("\"text\":\"Short\"}") != std::string::npos)
+    }
+
+    void test_text_views() {
+        Logger::instance().configuration().set_verbosity(1);
+        auto captured = capture_ndjson("log_views.ndjson",[] {
+            for (auto use_scheduler : {&Logger::use_immediate_scheduler,&Logger::use_blocking_scheduler,&Logger::use_nonblocking_scheduler}) {
+                (Logger::instance().*use_scheduler)();
+                std::string const text = "string view of a string";
+                char const* pointer = "pointer";
+                char buffer[] = "buffer";
+                Logger::instance().println(0,"literal with {} kept");
+                Logger::instance().println(0,std::string_view(text).substr(0,11));
+                Logger::instance().println(0,pointer);
+                Logger::instance().println(0,buffer);
+                // The buffer must have been copied
+                buffer[0] = 'x';
+                Logger::instance().println(0,text);
+                Logger::instance().hold("scope","held literal");
+                Logger::instance().release("scope");
+                Logger::instance().flush();
+            }
+        });
+        std::vector<std::string> lines;
+        for (auto const& line : captured) if (line.find("\"println\"") != std::string::npos) lines.push_back(line);
+        CONCLOG_TEST_EQUALS(lines.size(),15)
+        if (lines.size() != 15) return;
+        for (SizeType offset : {SizeType(0),SizeType(5),SizeType(10)}) {
+            CONCLOG_TEST_ASSERT(lines[offset].find("\"text\":\"literal with {} kept\"}") != std::string::npos)
+            CONCLOG_TEST_ASSERT(lines[offset+1].find("\"text\":\"string view\"}") != std::string::npos)
+            CONCLOG_TEST_ASSERT(lines[offset+2].find("\"text\":\"pointer\"}") != std::string::npos)
+            CONCLOG_TEST_ASSERT(lines[offset+3].find("\"text\":\"buffer\"}") != std::string::npos)
+            CONCLOG_TEST_ASSERT(lines[offset+4].find("\"text\":\"string view of a string\"}") != std::string::npos)
+        }
+    }
+
+    void test_queue_slot_text() {
+        // Around the inline capacity of the queue slots, and well beyond it
+        std::vector<SizeType> const sizes = {0,1,183,184,185,1000,100};
+        Logger::instance().configuration().set_verbosity(1);
+        LoggerStatistics before, after;
+        auto lines = capture_ndjson("log_slots.ndjson",[&] {
+            Logger::instance().use_nonblocking_scheduler();
+            Logger::instance().configuration().set_payload_chunk_size(256);
+            before = Logger::instance().statistics();
+            for (unsigned int round=0; round<2; ++round) {
+                for (auto size : sizes) Logger::instance().println(0,std::string(size,static_cast<char>('a'+size%26)));
+                // The chunks of the first round are all free for the second one
+                Logger::instance().flush();
+            }
+            after = Logger::instance().statistics();
+            Logger::instance().configuration().set_payload_chunk_size(1024);
+        });
+        CONCLOG_PRINT_TEST_COMMENT(after)
+        CONCLOG_TEST_ASSERT(after.payload_chunks_allocated > before.payload_chunks_allocated)
+        CONCLOG_TEST_EQUALS(after.payload_bytes_allocated-before.payload_bytes_allocated,256*(after.payload_chunks_allocated-before.payload_chunks_allocated))
+        // The longest text alone takes 4 chunks
+        CONCLOG_TEST_ASSERT(after.payload_chunks_reused-before.payload_chunks_reused >= 4)
+        CONCLOG_TEST_EQUALS(lines.size(),2*sizes.size())
+        if (lines.size() != 2*sizes.size()) return;
+        for (SizeType i=0; i<lines.size(); ++i) {
+            auto size = sizes[i%sizes.size()];
+            CONCLOG_TEST_ASSERT(lines[i].find("\"text\":\""+std::string(size,static_cast<char>('a'+size%26))+"\"}") != std::string::npos)
+        }
+    }
+
+    void test_callsites() {
+        auto& registry = LogCallsiteRegistry::instance();
+        auto num_before = registry.callsites().size();
+        Logger::instance().configuration().set_verbosity(1);
+        LogCallsiteId id = 0;
+        auto lines = capture_ndjson("log_callsites.ndjson",[&] {
+            Logger::instance().use_nonblocking_scheduler();
+            auto print = [](unsigned int i) { CONCLOG_PRINTLN("callsite line " << i) }; unsigned int const line = __LINE__;
+            print(0);
+            print(1);
+            auto callsites = registry.callsites();
+            CONCLOG_TEST_EQUALS(callsites.size(),num_before+1)
+            auto callsite = callsites.back();
+            id = callsite->id();
+            CONCLOG_TEST_EQUALS(registry.callsite(callsite->id()),callsite)
+            CONCLOG_TEST_EQUALS(callsite->line(),line)
+            CONCLOG_TEST_EQUALS(callsite->level(),0)
+            CONCLOG_TEST_EQUALS(std::string(callsite->format()),"\"callsite line \" << i")
+            CONCLOG_TEST_ASSERT(std::string(callsite->file()).find("test_logging.cpp") != std::string::npos)
+            CONCLOG_TEST_ASSERT(std::string(callsite->function()).find("test_callsites") != std::string::npos)
+            callsite->set_enabled(false);
+            print(2);
+            callsite->set_enabled(true);
+            print(3);
+            CONCLOG_PRINTLN_FMT(0,"deferred {}",4)
+            CONCLOG_TEST_EQUALS(std::string(registry.callsites().back()->format()),"deferred {}")
+            CONCLOG_PRINTLN_TYPED(0,CONCLOG_FORMAT("typed {d}"),5)
+            CONCLOG_TEST_EQUALS(std::string(registry.callsites().back()->format()),"typed {d}")
+        });
+        CONCLOG_TEST_EQUALS(lines.size(),5)
+        if (lines.size() != 5) return;
+        auto id_field = [](LogCallsiteId i) { return "\"callsite\":" + std::to_string(i) + ","; };
+        CONCLOG_TEST_ASSERT(lines[0].find(id_field(id)) != std::string::npos)
+        CONCLOG_TEST_ASSERT(lines[2].find("\"text\":\"callsite line 3\"") != std::string::npos)
+        CONCLOG_TEST_ASSERT(lines[3].find(id_field(id+1)) != std::string::npos)
+        CONCLOG_TEST_ASSERT(lines[4].find(id_field(id+2)) != std::string::npos)
+    }
+
+    void test_verbosity_filters() {
+        Logger::instance().configuration().set_verbosity(1);
+        auto lines = capture_ndjson("log_filters.ndjson",[] {
+            auto print = [](unsigned int i) { CONCLOG_PRINTLN("other step " << i) };
+            Logger::instance().configuration().set_verbosity_filters(" *Reachability*:1, *reachability_step*:3,default:0");
+            CONCLOG_TEST_EQUALS(Logger::instance().configuration().verbosity_filters()," *Reachability*:1, *reachability_step*:3,default:0")
+            print_reachability_step(0);
+            print(0);
+            Logger::instance().configuration().set_verbosity_filters("*test_logging.cpp:1");
+            print_reachability_step(1);
+            print(1);
+            Logger::instance().configuration().set_verbosity_filters("");
+            print_reachability_step(2);
+            print(2);
+        });
+        CONCLOG_TEST_THROWS(Logger::instance().configuration().set_verbosity_filters("abc"),LoggerInvalidVerbosityFiltersException)
+        CONCLOG_TEST_THROWS(Logger::instance().configuration().set_verbosity_filters("*:x"),LoggerInvalidVerbosityFiltersException)
+        CONCLOG_TEST_THROWS(Logger::instance().configuration().set_verbosity_filters(":2"),LoggerInvalidVerbosityFiltersException)
+        CONCLOG_TEST_EQUALS(Logger::instance().configuration().verbosity_filters(),"")
+        CONCLOG_TEST_EQUALS(lines.size(),3)
+        if (lines.size() != 3) return;
+        CONCLOG_TEST_ASSERT(lines[0].find("\"text\":\"reachability step 0\"") != std::string::npos)
+        CONCLOG_TEST_ASSERT(lines[1].find("\"text\":\"other step 1\"") != std::string::npos)
+        CONCLOG_TEST_ASSERT(lines[2].find("\"text\":\"other step 2\"") != std::string::npos)
+    }
+
+    void test_thread_verbosity() {
+        Logger::instance().configuration().set_verbosity(1);
+        auto lines = capture_ndjson("log_thread_verbosity.ndjson",[] {
+            Logger::instance().use_nonblocking_scheduler();
+            std::promise<void> muted, overridden;
+            auto muted_future = muted.get_future();
+            auto overridden_future = overridden.get_future();
+            {
+                Thread thread([&muted,&overridden_future] {
+                    CONCLOG_PRINTLN_AT(1,"worker muted")
+                    muted.set_value();
+                    overridden_future.wait();
+                    CONCLOG_PRINTLN_AT(1,"worker overridden")
+                },"verbose_worker");
+                muted_future.wait();
+                Logger::instance().set_thread_verbosity("verbose_worker",2);
+                CONCLOG_PRINTLN_AT(1,"main muted")
+                overridden.set_value();
+            }
+            CONCLOG_TEST_THROWS(Logger::instance().set_thread_verbosity("verbose_worker",2),LoggerUnknownThreadException)
+            Logger::instance().set_thread_verbosity(std::this_thread::get_id(),2);
+            CONCLOG_PRINTLN_AT(1,"main overridden")
+            Logger::instance().use_blocking_scheduler();
+            CONCLOG_PRINTLN_AT(1,"main overridden after scheduler change")
+            Logger::instance().reset_thread_verbosity(std::this_thread::get_id());
+            CONCLOG_PRINTLN_AT(1,"main muted after reset")
+        });
+        CONCLOG_TEST_EQUALS(lines.size(),3)
+        if (lines.size() != 3) return;
+        CONCLOG_TEST_ASSERT(lines[0].find("\"text\":\"worker overridden\"") != std::string::npos)
+        CONCLOG_TEST_ASSERT(lines[1].find("\"text\":\"main overridden\"") != std::string::npos)
+        CONCLOG_TEST_ASSERT(lines[2].find("\"text\":\"main overridden after scheduler change\"") != std::string::npos)
+    }
+
+    void test_deferred_format() {
+        Logger::instance().configuration().set_verbosity(1);
+        auto lines = capture_ndjson("log_format.ndjson",[] {
+            for (bool nonblocking : {false,true}) {
+                if (nonblocking) Logger::instance().use_nonblocking_scheduler();
+                else Logger::instance().use_immediate_scheduler();
+                int i = -3;
+                double x = 2.5;
+                char c = 'c';
+                CONCLOG_PRINTLN_FMT(0,"i={}, x={}, c={}, b={}, s={}",i,x,c,true,"literal")
+                CONCLOG_PRINTLN_FMT(0,"No placeholders")
+                CONCLOG_PRINTLN_FMT(0,"Missing {} and {}",1u)
+                CONCLOG_PRINTLN_FMT(0,"Excess {}",1,2)
+                CONCLOG_PRINTLN_FMT(1,"Muted {}",1)
+                Logger::instance().flush();
+            }
+        });
+        CONCLOG_TEST_EQUALS(lines.size(),8)
+        if (lines.size() != 8) return;
+        for (SizeType offset : {SizeType(0),SizeType(4)}) {
+            CONCLOG_TEST_ASSERT(lines[offset].find("\"text\":\"i=-3, x=2.5, c=c, b=true, s=literal\"}") != std::string::npos)
+            CONCLOG_TEST_ASSERT(lines[offset+1].find("\"text\":\"No placeholders\"}") != std::string::npos)
+            CONCLOG_TEST_ASSERT(lines[offset+2].find("\"text\":\"Missing 1 and {}\"}") != std::string::npos)
+            CONCLOG_TEST_ASSERT(lines[offset+3].find("\"text\":\"Excess 1\"}") != std::string::npos)
+        }
+    }
+
+    void test_typed_format() {
+        auto format = CONCLOG_FORMAT("i={d}, h={x}, x={f}, c={s}, s={s}, b={}, t={}, {{literal}}");
+        CONCLOG_TEST_EQUALS(format.num_placeholders(),7)
+        std::string text;
+        format.write(text,-42,255u,2.5,'c',std::string("string"),true,ThreadNamePrintingPolicy::BEFORE);
+        CONCLOG_TEST_EQUALS(text,"i=-42, h=ff, x=2.5, c=c, s=string, b=true, t=BEFORE, {literal}")
+        auto no_placeholders = CONCLOG_FORMAT("No placeholders");
+        no_placeholders.write(text);
+        CONCLOG_TEST_EQUALS(text,"No placeholders")
+        auto adjacent_placeholders = CONCLOG_FORMAT("{}{s}");
+        adjacent_placeholders.write(text,0.1,"literal");
+        CONCLOG_TEST_EQUALS(text,"0.1literal")
+
+        Logger::instance().use_nonblocking_scheduler();
+        Logger::instance().configuration().set_verbosity(1);
+        auto lines = capture_ndjson("log_typed.ndjson",[] {
+            for (unsigned int i=0; i<3; ++i) CONCLOG_PRINTLN_TYPED(0,CONCLOG_FORMAT("Line {d} of {d}"),i,3)
+            CONCLOG_PRINTLN_TYPED(1,CONCLOG_FORMAT("Muted {d}"),1)
+        });
+        CONCLOG_TEST_EQUALS(lines.size(),3)
+        for (SizeType i=0; i<std::min(lines.size(),SizeType(3)); ++i)
+            CONCLOG_TEST_ASSERT(lines[i].find("\"text\":\"Line " + std::to_string(i) + " of 3\"}") != std::string::npos)
+    }
+
+    void test_flight_recorder() {
+        Logger::instance().use_immediate_scheduler();
+        Logger::instance().configuration().set_verbosity(1);
+        Logger::instance().configuration().set_recorder_verbosity(3);
+        Logger::instance().configuration().set_recorder_capacity(2);
+        CONCLOG_TEST_ASSERT(not Logger::instance().is_muted_at(0))
+        CONCLOG_TEST_ASSERT(Logger::instance().is_recorded_at(2))
+        CONCLOG_TEST_ASSERT(not Logger::instance().is_recorded_at(3))
+        Logger::instance().redirect_to_file("log_recorder.txt");
+        CONCLOG_PRINTLN("Shown line")
+        CONCLOG_PRINTLN_AT(1,"Recorded line overwritten")
+        CONCLOG_PRINTLN_AT(1,"Recorded line 1")
+        CONCLOG_PRINTLN_AT(3,"Discarded line")
+        CONCLOG_PRINTLN_AT(2,"Recorded line 2")
+        Logger::instance().dump_flight_recorder();
+        Logger::instance().dump_flight_recorder();
+        Logger::instance().redirect_to_console();
+        Logger::instance().configuration().set_recorder_verbosity(0);
+
+        std::ifstream file("log_recorder.txt");
+        std::vector<std::string> lines;
+        std::string line;
+        while (getline(file,line)) lines.push_back(line);
+        file.close();
+        std::remove("log_recorder.txt");
+        CONCLOG_TEST_EQUALS(lines.size(),3)
+        CONCLOG_TEST_ASSERT(lines.at(0).find("Shown line") != std::string::npos)
+        CONCLOG_TEST_ASSERT(lines.at(1).find("@2|  Recorded line 1") != std::string::npos)
+        CONCLOG_TEST_ASSERT(lines.at(2).find("@3|   Recorded line 2") != std::string::npos)
+    }
+
+    void test_emergency_flush_on_fatal_signal() {
+#ifndef _WIN32
+        // Fork from a state with no consumer thread, so that the child is able to start its own
+        Logger::instance().use_immediate_scheduler();
+        std::remove("log_emergency.txt");
+        pid_t pid = fork();
+        if (pid == 0) {
+            Logger::instance().use_nonblocking_scheduler();
+            Logger::instance().install_fatal_signal_handlers();
+            Logger::instance().redirect_to_file("log_emergency.txt");
+            Logger::instance().configuration().set_verbosity(20);
+            Logger::instance().configuration().set_recorder_verbosity(21);
+            CONCLOG_PRINTLN_AT(20,"Recorded line")
+            // Printing the hold after a high level line stalls the consumer long enough for the next lines to stay enqueued
+            CONCLOG_PRINTLN_AT(16,"High level line")
+            CONCLOG_SCOPE_PRINTHOLD("held")
+            CONCLOG_PRINTLN("Pending line 1")
+            CONCLOG_PRINTLN("Pending line 2")
+            std::abort();
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        CONCLOG_TEST_ASSERT(WIFSIGNALED(status) and WTERMSIG(status) == SIGABRT)
+
+        std::ifstream file("log_emergency.txt");
+        std::string content((std::istreambuf_iterator<char>(file)),std::istreambuf_iterator<char>());
+        file.close();
+        std::remove("log_emergency.txt");
+        CONCLOG_TEST_PRINT(content)
+        CONCLOG_TEST_ASSERT(content.find("main@1| Pending line 1\nmain@1| Pending line 2\n") != std::string::npos)
+        CONCLOG_TEST_ASSERT(content.find("@21| Recorded line\n") != std::string::npos)
+#else
+        CONCLOG_TEST_SKIP(test_emergency_flush_on_fatal_signal())
+#endif
+    }
+
     void test_multiple_threads_with_blocking_scheduler() {
         Logger::instance().use_blocking_scheduler();
         Logger::instance().configuration().set_verbosity(3);
@@ -366,10 +746,14 @@ class TestLogging {
         Logger::instance().configuration().set_thread_name_printing_policy(ThreadNamePrintingPolicy::BEFORE);
         CONCLOG_PRINTLN("Printing on the " << Logger::instance().current_thread_name() << " thread without other threads");
         CONCLOG_TEST_EQUALS(Logger::instance().cached_last_printed_thread_name().compare("main"), 0);
-        Thread thread1([] { print_something1(); },"thr1");
-        Thread thread2([] { print_something2(); },"thr2");
-        CONCLOG_PRINTLN("Printing again on the main thread, but with other threads");
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        std::promise<void> main_printed;
+        std::shared_future<void> main_printed_future = main_printed.get_future().share();
+        {
+            Thread thread1([main_printed_future] { main_printed_future.wait(); print_something1(); },"thr1");
+            Thread thread2([main_printed_future] { main_printed_future.wait(); print_something2(); },"thr2");
+            CONCLOG_PRINTLN("Printing again on the main thread, but with other threads");
+            main_printed.set_value();
+        }
         CONCLOG_TEST_PRINT(Logger::instance().cached_last_printed_thread_name());
         CONCLOG_TEST_ASSERT(Logger::instance().cached_last_printed_thread_name().compare("thr1") == 0 or
                             Logger::instance().cached_last_printed_thread_name().compare("thr2") == 0);
@@ -389,7 +773,125 @@ class TestLogging {
         Thread thread5([] { print_something1(); });
         Thread thread6([] { print_something1(); });
         CONCLOG_PRINTLN("Printing again on the main thread, but with other threads");
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        Logger::instance().flush();
+    }
+
+    void test_flush() {
+        Logger::instance().use_nonblocking_scheduler();
+        Logger::instance().configuration().set_verbosity(1);
+        Logger::instance().configuration().set_theme(TT_THEME_NONE);
+        Logger::instance().redirect_to_file("log_flush.txt");
+        const unsigned int num_lines = 100;
+        {
+            Thread thread([] { for (unsigned int i=0; i<num_lines; ++i) CONCLOG_PRINTLN("Line " << i << " from thread") },"thr");
+        }
+        for (unsigned int i=0; i<num_lines; ++i) CONCLOG_PRINTLN("Line " << i << " from main")
+        Logger::instance().flush();
+
+        auto count_lines = [](const char* filename) {
+            std::ifstream file(filename);
+            std::string line;
+            SizeType count = 0;
+            while (getline(file,line)) ++count;
+            return count;
+        };
+        CONCLOG_TEST_EQUALS(count_lines("log_flush.txt"),2*num_lines)
+        CONCLOG_PRINTLN("Last line")
+        auto future = Logger::instance().flush_async();
+        future.get();
+        CONCLOG_TEST_EQUALS(count_lines("log_flush.txt"),2*num_lines+1)
+        // Flushing from the consumption thread returns without waiting for the message being written
+        CONCLOG_PRINTLN_FMT(0,"Flushing value {}",FlushingValue{7})
+        Logger::instance().flush();
+        CONCLOG_TEST_EQUALS(count_lines("log_flush.txt"),2*num_lines+2)
+        Logger::instance().redirect_to_console();
+        std::remove("log_flush.txt");
+    }
+
+    void test_scheduler_change_with_registered_threads() {
+        Logger::instance().use_nonblocking_scheduler();
+        Logger::instance().configuration().set_verbosity(3);
+        Logger::instance().configuration().set_thread_name_printing_policy(ThreadNamePrintingPolicy::BEFORE);
+        std::atomic<bool> stop(false);
+        std::atomic<bool> state_preserved(true);
+        std::atomic<SizeType> num_prints(0);
+        std::promise<void> level_increased;
+        auto level_increased_future = level_increased.get_future();
+        {
+            Thread thread([&] {
+                Logger::instance().increase_level(2);
+                level_increased.set_value();
+                while (not stop) {
+                    if (num_prints % 1000 == 0) CONCLOG_PRINTLN("Print " << num_prints)
+                    else CONCLOG_PRINTLN_AT(1,"Hidden print")
+                    ++num_prints;
+                    if (Logger::instance().current_level() != 3 or Logger::instance().current_thread_name() != "swp") state_preserved = false;
+                }
+                Logger::instance().decrease_level(2);
+            },"swp");
+            level_increased_future.get();
+            auto before = Logger::instance().statistics();
+            Logger::instance().use_blocking_scheduler();
+            Logger::instance().use_nonblocking_scheduler();
+            Logger::instance().use_immediate_scheduler();
+            Logger::instance().use_blocking_scheduler();
+            Logger::instance().use_nonblocking_scheduler();
+            CONCLOG_PRINTLN("Printing after changing scheduler")
+            // The counters of the released schedulers are retained
+            CONCLOG_TEST_ASSERT(Logger::instance().statistics().messages_enqueued > before.messages_enqueued)
+            stop = true;
+        }
+        CONCLOG_TEST_PRINT(num_prints.load())
+        CONCLOG_TEST_ASSERT(state_preserved.load())
+        CONCLOG_TEST_EQUALS(Logger::instance().current_level(),1)
+        Logger::instance().configuration().set_thread_name_printing_policy(ThreadNamePrintingPolicy::NEVER);
+    }
+
+    void test_configuration_snapshots() {
+        // No other thread reads the configuration, hence none caches the snapshots
+        Logger::instance().use_immediate_scheduler();
+        auto& configuration = Logger::instance().configuration();
+        configuration.set_verbosity(2);
+        auto snapshot = configuration.snapshot();
+        configuration.set_verbosity(1);
+        configuration.add_custom_keyword("snapshot",TT_STYLE_DARKORANGE);
+        CONCLOG_TEST_EQUALS(snapshot->verbosity,2)
+        CONCLOG_TEST_EQUALS(configuration.verbosity(),1)
+        CONCLOG_TEST_EQUALS(snapshot->keyword_styles.count("snapshot"),0)
+        CONCLOG_TEST_EQUALS(configuration.snapshot()->keyword_styles.count("snapshot"),1)
+        CONCLOG_TEST_EQUALS(configuration.snapshot()->keyword_styles.count("inf"),1)
+        // Released once not held nor cached by any thread
+        std::weak_ptr<LoggerConfigurationSnapshot const> released = snapshot;
+        snapshot.reset();
+        CONCLOG_TEST_ASSERT(released.expired())
+
+        Logger::instance().use_nonblocking_scheduler();
+        Logger::instance().redirect_to_file("log_snapshots.txt");
+        const unsigned int num_lines = 1000;
+        const unsigned int num_changes = 200;
+        {
+            Thread thread([&configuration] {
+                for (unsigned int i=0; i<num_changes; ++i) {
+                    configuration.set_theme(i % 2 == 0 ? TT_THEME_DARK : TT_THEME_NONE);
+                    configuration.set_prints_level_on_change_only(i % 2 == 0);
+                    configuration.add_custom_keyword("keyword" + std::to_string(i));
+                }
+            },"cfg");
+            for (unsigned int i=0; i<num_lines; ++i) CONCLOG_PRINTLN("val=inf, x0=2.0^3*1.32424242432423[2,3], keyword" << i)
+        }
+        Logger::instance().flush();
+        Logger::instance().redirect_to_console();
+        Logger::instance().use_immediate_scheduler();
+        configuration.set_theme(TT_THEME_NONE);
+        configuration.set_prints_level_on_change_only(true);
+
+        std::ifstream file("log_snapshots.txt");
+        std::string line;
+        SizeType count = 0;
+        while (getline(file,line)) ++count;
+        file.close();
+        std::remove("log_snapshots.txt");
+        CONCLOG_TEST_EQUALS(count,num_lines)
     }
 
     void test_register_self_thread() {
@@ -406,6 +908,188 @@ class TestLogging {
         Logger::instance().unregister_thread(thread_id);
     }
 
+    void test_automatic_thread_registration() {
+        Logger::instance().configuration().set_verbosity(3);
+        Logger::instance().configuration().set_thread_name_printing_policy(ThreadNamePrintingPolicy::BEFORE);
+        for (int i=0; i<2; ++i) {
+            if (i == 0) Logger::instance().use_blocking_scheduler();
+            else Logger::instance().use_nonblocking_scheduler();
+            std::atomic<bool> state_preserved(true);
+            {
+                std::vector<std::thread> threads;
+                for (unsigned int t=0; t<4; ++t) {
+                    threads.emplace_back([&state_preserved,t] {
+                        std::ostringstream id;
+                        id << std::this_thread::get_id();
+                        CONCLOG_PRINTLN("Printing without registration")
+                        Logger::instance().increase_level(t);
+                        CONCLOG_PRINTLN_AT(1,"Printing at level " << 1+t)
+                        if (Logger::instance().current_level() != 1+t or Logger::instance().current_thread_name() != id.str()) state_preserved = false;
+                        Logger::instance().decrease_level(t);
+                    });
+                }
+                for (auto& thread : threads) thread.join();
+            }
+            Logger::instance().flush();
+            CONCLOG_TEST_ASSERT(state_preserved.load())
+            CONCLOG_TEST_EQUALS(Logger::instance().current_level(),1)
+        }
+        Logger::instance().configuration().set_thread_name_printing_policy(ThreadNamePrintingPolicy::NEVER);
+    }
+
+    void test_context_propagation() {
+        Logger::instance().use_nonblocking_scheduler();
+        Logger::instance().configuration().set_verbosity(3);
+        Logger::instance().configuration().set_thread_name_printing_policy(ThreadNamePrintingPolicy::BEFORE);
+        CONCLOG_SCOPE_CREATE
+        auto context = Logger::instance().current_context();
+        CONCLOG_TEST_EQUALS(context.level(),2)
+        CONCLOG_TEST_EQUALS(context.scopes().size(),1)
+
+        auto future = async_with_log_context(std::launch::async,[](unsigned int level_increase) {
+            CONCLOG_PRINTLN_AT(level_increase,"Printing from a task launched asynchronously")
+            return Logger::instance().current_context();
+        },1u);
+        auto task_context = future.get();
+        CONCLOG_TEST_EQUALS(task_context.level(),2)
+        CONCLOG_TEST_EQUALS(task_context.thread_name(),Logger::instance().current_thread_name())
+        CONCLOG_TEST_EQUALS(task_context.scopes().size(),1)
+
+        std::atomic<bool> context_restored(false);
+        std::atomic<bool> registered_name_kept(false);
+        auto task = with_log_context([&registered_name_kept] {
+            CONCLOG_PRINTLN("Printing from a task run by an executor")
+            // The logical name of the task does not replace the name the executor is registered with
+            Logger::instance().set_thread_verbosity("executor",3);
+            Logger::instance().reset_thread_verbosity("executor");
+            registered_name_kept = true;
+        });
+        {
+            Thread executor([&] {
+                auto executor_context = Logger::instance().current_context();
+                task();
+                auto after_context = Logger::instance().current_context();
+                context_restored = (after_context.level() == executor_context.level() and after_context.thread_name() == executor_context.thread_name()
+                                    and after_context.scopes().empty());
+                CONCLOG_PRINTLN("Printing from the executor after the task")
+            },"executor");
+        }
+        Logger::instance().flush();
+        CONCLOG_TEST_ASSERT(context_restored.load())
+        CONCLOG_TEST_ASSERT(registered_name_kept.load())
+        Logger::instance().configuration().set_thread_name_printing_policy(ThreadNamePrintingPolicy::NEVER);
+    }
+
+    void test_scope_profiler() {
+        Logger::instance().configuration().set_verbosity(0);
+        Logger::instance().configuration().set_profiles_scopes(true);
+        for (unsigned int i=0; i<3; ++i) sample_printhold_simple_loop("profiled",0);
+        std::thread thread([] { sample_printhold_simple_loop("profiled",0); sample_function(); });
+        thread.join();
+        Logger::instance().configuration().set_profiles_scopes(false);
+        sample_function();
+        auto report = Logger::instance().profile_report();
+        Logger::instance().configuration().set_verbosity(1);
+        CONCLOG_PRINTLN("Profile report:\n" << report)
+        auto calls_of = [&report](std::string const& scope) {
+            auto pos = report.find(scope);
+            if (pos == std::string::npos) return 0ul;
+            return std::stoul(report.substr(report.rfind('\n',pos)+1));
+        };
+        CONCLOG_TEST_EQUALS(calls_of("sample_printhold_simple_loop"),4)
+        CONCLOG_TEST_EQUALS(calls_of("sample_function"),1)
+    }
+
+    void test_trace_export() {
+        Logger::instance().configuration().set_verbosity(2);
+        Logger::instance().trace_to_file("trace.json");
+        std::thread thread([] {
+            ProgressIndicator indicator(3.0);
+            for (unsigned int i=0; i<3; ++i) {
+                sample_function();
+                indicator.update_current(i+1);
+                CONCLOG_TRACE_COUNTER("progress",indicator.percentage())
+            }
+        });
+        sample_function();
+        thread.join();
+        Logger::instance().flush();
+        sample_function();
+        Logger::instance().stop_tracing();
+
+        std::ifstream file("trace.json");
+        std::string trace((std::istreambuf_iterator<char>(file)),std::istreambuf_iterator<char>());
+        file.close();
+        std::remove("trace.json");
+        auto count = [&trace](std::string const& text) {
+            SizeType result = 0;
+            for (auto pos = trace.find(text); pos != std::string::npos; pos = trace.find(text,pos+1)) ++result;
+            return result;
+        };
+        CONCLOG_TEST_ASSERT(trace.rfind("[\n",0) == 0)
+        CONCLOG_TEST_ASSERT(trace.find("\n]\n") == trace.size()-3)
+        CONCLOG_TEST_EQUALS(count("\"ph\":\"B\""),5)
+        CONCLOG_TEST_EQUALS(count("\"ph\":\"E\""),5)
+        CONCLOG_TEST_EQUALS(count("\"ph\":\"i\""),5)
+        CONCLOG_TEST_EQUALS(count("\"ph\":\"C\""),3)
+        CONCLOG_TEST_EQUALS(count("\"thread_name\""),2)
+        CONCLOG_TEST_ASSERT(not Logger::instance().is_tracing())
+    }
+
+    void test_statistics() {
+        Logger::instance().use_nonblocking_scheduler();
+        Logger::instance().configuration().set_verbosity(2);
+        auto before = Logger::instance().statistics();
+        auto thread_before = Logger::instance().current_thread_statistics();
+        std::thread thread([] { for (unsigned int i=0; i<10; ++i) CONCLOG_PRINTLN("thread line " << i) });
+        for (unsigned int i=0; i<10; ++i) CONCLOG_PRINTLN("main line " << i)
+        thread.join();
+        Logger::instance().flush();
+        auto after = Logger::instance().statistics();
+        CONCLOG_PRINT_TEST_COMMENT(after)
+        CONCLOG_TEST_EQUALS(after.messages_enqueued-before.messages_enqueued,20)
+        CONCLOG_TEST_EQUALS(Logger::instance().current_thread_statistics().messages_enqueued-thread_before.messages_enqueued,10)
+        CONCLOG_TEST_ASSERT(after.bytes_enqueued-before.bytes_enqueued >= 20*12)
+        CONCLOG_TEST_EQUALS(after.messages_written-before.messages_written,20)
+        CONCLOG_TEST_EQUALS(after.bytes_written-before.bytes_written,after.bytes_enqueued-before.bytes_enqueued)
+        CONCLOG_TEST_EQUALS(after.queue_depth,0)
+        CONCLOG_TEST_ASSERT(after.queue_high_water >= 1)
+        CONCLOG_TEST_ASSERT(after.consumer_busy_time+after.consumer_idle_time > std::chrono::nanoseconds(0))
+
+        Logger::instance().configuration().set_statistics_summary_period(std::chrono::milliseconds(1));
+        CONCLOG_PRINTLN("starts the period")
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        CONCLOG_PRINTLN("follows the summary")
+        Logger::instance().configuration().set_statistics_summary_period(std::chrono::milliseconds(0));
+        Logger::instance().flush();
+        auto summarised = Logger::instance().statistics();
+        CONCLOG_TEST_EQUALS(summarised.messages_enqueued-after.messages_enqueued,3)
+    }
+
+    void test_latency_report() {
+        Logger::instance().use_nonblocking_scheduler();
+        Logger::instance().configuration().set_verbosity(2);
+        Logger::instance().configuration().set_traces_latency(true);
+        std::thread thread([] { for (unsigned int i=0; i<5; ++i) CONCLOG_PRINTLN("thread line " << i) });
+        for (unsigned int i=0; i<5; ++i) CONCLOG_PRINTLN("main line " << i)
+        thread.join();
+        Logger::instance().flush();
+        Logger::instance().configuration().set_traces_latency(false);
+
+        auto report = Logger::instance().latency_report();
+        CONCLOG_PRINT_TEST_COMMENT("\n" << report)
+        auto lines_of = [&report](std::string const& source) {
+            std::istringstream is(report);
+            std::string line;
+            while (std::getline(is,line))
+                if (line.size() >= source.size() and line.compare(line.size()-source.size(),source.size(),source) == 0)
+                    return std::stoul(line);
+            return 0ul;
+        };
+        CONCLOG_TEST_EQUALS(lines_of("(nonblocking)"),10)
+        CONCLOG_TEST_EQUALS(lines_of("thread main"),5)
+    }
+
     void test_printing_policy_with_theme_and_print_level(bool use_theme, bool print_level) {
         CONCLOG_PRINT_TEST_COMMENT("Policies: " << ThreadNamePrintingPolicy::BEFORE << " " << ThreadNamePrintingPolicy::AFTER << " " << ThreadNamePrintingPolicy::NEVER)
         Logger::instance().use_immediate_scheduler();
@@ -0,0 +1,45 @@
+/***************************************************************************
+ *            test_typed_format_mismatch.cpp
+ *
+ *  Copyright  2021  Luca Geretti
+ *
+ ****************************************************************************/
+
+/*
+ * This file is part of CONCLOG, under the MIT license.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+// Each of the definitions makes the build fail, as checked by the corresponding test
+
+#include "logging.hpp"
+
+using namespace ConcLog;
+
+int main() {
+#if defined(CONCLOG_WRONG_ARGUMENT_COUNT)
+    CONCLOG_PRINTLN_TYPED(0,CONCLOG_FORMAT("x={d}, y={d}"),1)
+#elif defined(CONCLOG_WRONG_ARGUMENT_TYPE)
+    CONCLOG_PRINTLN_TYPED(0,CONCLOG_FORMAT("x={d}"),1.5)
+#elif defined(CONCLOG_INVALID_PLACEHOLDER)
+    CONCLOG_PRINTLN_TYPED(0,CONCLOG_FORMAT("x={y}"),1)
+#else
+    CONCLOG_PRINTLN_TYPED(0,CONCLOG_FORMAT("x={d}"),1)
+#endif
+    return 0;
+}